@@ -0,0 +1,115 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "lib/pwm_batch.h"
+#include "lib/pwm_computer.h"
+
+/*
+ * Throughput of the scalar (per channel, as in the daemon) and batch
+ * evaluation of PWM adjusting functions and ramp filtering, over a random
+ * temperature trace. Also checks both give identical results.
+ *
+ * Usage: bench-pwm [channels] [cycles]
+ */
+
+typedef std::chrono::steady_clock bench_clock;
+
+static const int32_t fan_speed_running = 1000;
+
+int main(int argc, char ** argv) {
+  const std::size_t channels = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 12;
+  const std::size_t cycles = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+  const std::size_t trace_length = 4096;
+
+  std::mt19937 rng(42);
+  std::vector<std::unique_ptr<pwm_computer> > computers;
+  std::vector<int32_t> temp_hyst, min_stop;
+  pwm_batch batch;
+  for (std::size_t i = 0; i < channels; ++i) {
+    long min_temp = 25000 + static_cast<long>(rng() % 10000);
+    long max_temp = min_temp + 20000 + static_cast<long>(rng() % 30000);
+    long stop = 60 + static_cast<long>(rng() % 80);
+    long min_pwm = (i % 2) ? 0 : stop;
+    if (i % 3)
+      computers.emplace_back(new quadratic_pwm_computer(
+            min_temp, max_temp, stop, min_pwm, 255));
+    else
+      computers.emplace_back(new linear_pwm_computer(
+            min_temp, max_temp, stop, min_pwm, 255));
+    temp_hyst.push_back(2500);
+    min_stop.push_back(static_cast<int32_t>(stop));
+    batch.add(computers.back()->get_curve(), temp_hyst.back());
+  }
+
+  // Random walk per channel, laid out cycle by cycle
+  std::vector<int32_t> trace(trace_length * channels);
+  std::uniform_int_distribution<int32_t> delta(-1500, 1500);
+  for (std::size_t i = 0; i < channels; ++i) {
+    int32_t temp = 40000;
+    for (std::size_t c = 0; c < trace_length; ++c) {
+      temp += delta(rng);
+      if (temp < 15000 || temp > 90000)
+        temp = 40000;
+      trace[c * channels + i] = temp;
+    }
+  }
+
+  // Scalar path
+  std::vector<int32_t> pwm(channels, 0), fan_speed(channels, 0),
+                       up_step(channels, 0);
+  uint64_t scalar_sum = 0;
+  bench_clock::time_point start = bench_clock::now();
+  for (std::size_t c = 0; c < cycles; ++c) {
+    const int32_t * temperature = &trace[(c % trace_length) * channels];
+    for (std::size_t i = 0; i < channels; ++i) {
+      int32_t temp = temperature[i];
+      if (!fan_speed[i])
+        temp -= temp_hyst[i];
+      int32_t computed = static_cast<int32_t>(computers[i]->pwm_for(temp));
+      pwm[i] = pwm_ramp(computed, pwm[i], fan_speed[i], min_stop[i],
+                        &up_step[i]);
+      fan_speed[i] = pwm[i] ? fan_speed_running : 0;
+      scalar_sum += static_cast<uint32_t>(pwm[i]);
+    }
+  }
+  std::chrono::duration<double> scalar_time = bench_clock::now() - start;
+  std::vector<int32_t> scalar_pwm(pwm), scalar_up_step(up_step);
+
+  // Batch path
+  std::fill(pwm.begin(), pwm.end(), 0);
+  std::fill(fan_speed.begin(), fan_speed.end(), 0);
+  std::fill(up_step.begin(), up_step.end(), 0);
+  std::vector<int32_t> new_pwm(channels);
+  uint64_t batch_sum = 0;
+  start = bench_clock::now();
+  for (std::size_t c = 0; c < cycles; ++c) {
+    const int32_t * temperature = &trace[(c % trace_length) * channels];
+    batch.update(temperature, pwm.data(), fan_speed.data(), up_step.data(),
+                 new_pwm.data());
+    for (std::size_t i = 0; i < channels; ++i) {
+      pwm[i] = new_pwm[i];
+      fan_speed[i] = pwm[i] ? fan_speed_running : 0;
+      batch_sum += static_cast<uint32_t>(pwm[i]);
+    }
+  }
+  std::chrono::duration<double> batch_time = bench_clock::now() - start;
+
+  const double updates = static_cast<double>(channels * cycles);
+  std::cout << channels << " channels, " << cycles << " cycles\n"
+            << "scalar: " << updates / scalar_time.count()
+            << " channel-updates/s\n"
+            << "batch:  " << updates / batch_time.count()
+            << " channel-updates/s" << std::endl;
+
+  if (scalar_sum != batch_sum || scalar_pwm != pwm ||
+      scalar_up_step != up_step) {
+    std::cerr << "Scalar and batch results differ!" << std::endl;
+    return 1;
+  }
+  return 0;
+}
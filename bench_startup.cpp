@@ -0,0 +1,134 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * Startup latency of fancontrolcpp: time from fork() to the first write
+ * to the PWM device, on a fake hwmon channel in a temporary directory.
+ * Measured without configuration cache, with it, and with it and
+ * safe_start. Needs to write /run/fancontrolcpp.pid like the daemon.
+ */
+
+typedef std::chrono::steady_clock bench_clock;
+
+static void write_file(const std::string &path, const std::string &content) {
+  std::ofstream out(path, std::ios::trunc);
+  out << content << "\n";
+  if (!out)
+    throw std::runtime_error("Unable to write " + path + "!");
+}
+
+static void write_config(const std::string &dir, bool safe_start) {
+  write_file(dir + "/conf",
+      "poll_interval=1\n"
+      "status_page=\n" +
+      std::string(safe_start ? "safe_start=true\n" : "") +
+      "pwm_ctrl1=" + dir + "/pwm1\n"
+      "fan_sensor1=" + dir + "/fan1_input\n"
+      "temp_sensor1=" + dir + "/temp1_input\n"
+      "min_temp1=30000\n"
+      "max_temp1=65000\n"
+      "temp_hyst1=2500\n"
+      "min_start1=128\n"
+      "min_stop1=100\n"
+      "min_speed1=300\n"
+      "min_pwm1=0\n"
+      "max_pwm1=254");
+}
+
+// Microseconds until the first PWM write, or -1 on timeout
+static double run_once(const std::string &binary, const std::string &dir) {
+  write_file(dir + "/pwm1", "0");
+  int in = inotify_init1(IN_CLOEXEC);
+  if (in < 0 || inotify_add_watch(in, (dir + "/pwm1").c_str(), IN_MODIFY) < 0)
+    throw std::runtime_error("Unable to watch PWM file!");
+
+  bench_clock::time_point start = bench_clock::now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    const std::string conf = dir + "/conf";
+    const std::string cache = dir + "/cache";
+    execl(binary.c_str(), binary.c_str(), "-c", conf.c_str(),
+          "--config-cache", cache.c_str(), static_cast<char *>(nullptr));
+    _exit(127);
+  }
+
+  pollfd pfd = {in, POLLIN, 0};
+  double elapsed = -1.0;
+  if (poll(&pfd, 1, 5000) > 0)
+    elapsed = std::chrono::duration<double, std::micro>(
+        bench_clock::now() - start).count();
+
+  kill(pid, SIGINT);
+  int status;
+  waitpid(pid, &status, 0);
+  close(in);
+  return elapsed;
+}
+
+static void run_series(const std::string &label, const std::string &binary,
+                       const std::string &dir, bool keep_cache, int runs) {
+  std::vector<double> times;
+  if (keep_cache)
+    run_once(binary, dir);  // Creates the cache
+  for (int i = 0; i < runs; ++i) {
+    if (!keep_cache)
+      unlink((dir + "/cache").c_str());
+    double t = run_once(binary, dir);
+    if (t < 0.0)
+      throw std::runtime_error("No PWM write from " + binary + "!");
+    times.push_back(t);
+  }
+  std::sort(times.begin(), times.end());
+  std::cout << label << ": min " << times.front() / 1000.0
+            << "ms, median " << times[times.size() / 2] / 1000.0
+            << "ms to first PWM write" << std::endl;
+}
+
+int main(int argc, char ** argv) {
+  const std::string binary = argc > 1 ? argv[1] : "./fancontrolcpp";
+  const int runs = argc > 2 ? std::atoi(argv[2]) : 20;
+  char dir_template[] = "/tmp/fancontrolcpp-bench.XXXXXX";
+  if (!mkdtemp(dir_template)) {
+    std::cerr << "Unable to create temporary directory!" << std::endl;
+    return 1;
+  }
+  const std::string dir(dir_template);
+
+  int ret = 0;
+  try {
+    write_file(dir + "/pwm1_enable", "0");
+    write_file(dir + "/fan1_input", "1000");
+    write_file(dir + "/temp1_input", "50000");
+
+    write_config(dir, false);
+    run_series("no cache", binary, dir, false, runs);
+    run_series("cache", binary, dir, true, runs);
+    write_config(dir, true);
+    run_series("cache, safe_start", binary, dir, true, runs);
+  } catch (const std::runtime_error & e) {
+    std::cerr << e.what() << std::endl;
+    ret = 1;
+  }
+
+  for (const char * name : {"pwm1", "pwm1_enable", "fan1_input",
+                            "temp1_input", "conf", "cache"})
+    unlink((dir + "/" + name).c_str());
+  rmdir(dir.c_str());
+  return ret;
+}
@@ -3,10 +3,13 @@
 #include <iostream>
 #include <string>
 #include <list>
+#include <memory>
 #include <utility>
 #include <vector>
 #include <algorithm>
 #include "lib/fancontroller.h"
+#include "lib/hwmon_index.h"
+#include "lib/probes.h"
 
 /*
  * TODO:
@@ -62,11 +65,14 @@ static void find_min_start(fancontroller * fc, int samples, int interval) {
     fc->set_fan_pwm(pwm);
     sleep(interval);
 
-    if (fc->read_temperature() >= fc->get_max_temp()) {
+    long temperature = fc->read_temperature();
+    long fan_speed = fc->read_fan_speed();
+    FC_PROBE4(calibrate_step, 1, pwm, fan_speed, temperature);
+    if (temperature >= fc->get_max_temp()) {
       throw std::runtime_error("Temperature too high!");
     }
 
-    if (fc->read_fan_speed()) {
+    if (fan_speed) {
       std::cout << "Fan started, starting validation" << std::endl;
       fc->set_fan_pwm(fc->get_min_stop());
       bool ok = true;
@@ -118,6 +124,7 @@ static void find_min_stop_min_speed_min_temp(fancontroller * fc,
       fan_speed_history.push(fan_speed);
       long temperature = fc->read_temperature();
       temperature_history.push(temperature);
+      FC_PROBE4(calibrate_step, 0, pwm, fan_speed, temperature);
 
       if (temperature >= fc->get_max_temp()) {
         throw std::runtime_error("Temperature too high!");
@@ -167,24 +174,28 @@ static void calibrate(fancontroller * fc,
 }
 
 
-int main() {
-  const std::string PATH_SYS("/sys/");
-  const std::string PATH_HWMON("class/hwmon");
-  const std::string PATH_DEVICE("devices/");
-
-  const std::string driver_name("f71882fg.2560");
-  // TODO: add function to find which hwmon to use from driver name
-  //       by resolving symlinks from PATH_HWMON
-  const std::string hwmon_path("platform/f71882fg.2560/hwmon/hwmon1/");
-  // resolve device from hwmon_path
-  const std::string hwmon_device("platform/f71882fg.2560/");
-
+int main(int argc, char ** argv) {
+  if (argc != 1 && argc != 4) {
+    std::cerr << "Usage: " << argv[0] << " [pwm_ctrl fan_sensor temp_sensor]\n"
+              << "Devices as paths, chip:attribute or label:text"
+              << std::endl;
+    return 1;
+  }
+  // Paths are resolved from driver name, whatever hwmonN the chip got
+  std::unique_ptr<hwmon_index> hwmon;
+  auto device = [&hwmon](const char * ref, const char * kind) {
+    if (!hwmon_index::is_reference(ref))
+      return std::string(ref);
+    if (!hwmon)
+      hwmon.reset(new hwmon_index());
+    return hwmon->resolve(ref, kind);
+  };
   const std::string pwm_ctrl =
-    PATH_SYS + PATH_DEVICE + hwmon_device + "pwm2";
+    device(argc > 1 ? argv[1] : "f71882fg:pwm2", "pwm");
   const std::string fan_sensor =
-    PATH_SYS + PATH_DEVICE + hwmon_device + "fan2_input";
+    device(argc > 1 ? argv[2] : "f71882fg:fan2", "fan");
   const std::string temp_sensor =
-    PATH_SYS + PATH_DEVICE + hwmon_device + "temp1_input";
+    device(argc > 1 ? argv[3] : "f71882fg:temp1", "temp");
   long min_temp  = 0;
   long max_temp  = 85000;
   long min_start = 0;
@@ -202,6 +213,8 @@ int main() {
   double precision = 0.015;  // 1.5%
 
   calibrate(&fc, samples, interval, precision);
+  FC_PROBE4(calibrate_done, fc.get_min_start(), fc.get_min_stop(),
+            fc.get_min_speed(), fc.get_min_temp());
 
   std::cout << "Calibration report" <<
      "\nmin_temp:  " << fc.get_min_temp() <<
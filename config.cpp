@@ -0,0 +1,532 @@
+#include "lib/config.h"
+
+#include <sys/stat.h>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "lib/status_page.h"
+
+namespace {
+
+enum option_type { TEXT, LONG, UNSIGNED, REAL, BOOLEAN };
+
+struct option {
+  const char * name;
+  option_type type;
+  bool channel;                 // name + N
+  bool required;                // For each defined channel, if channel
+  const char * default_value;   // nullptr for none
+  const char * help;
+};
+
+const option options[] = {
+  {"poll_interval", UNSIGNED, false, true, nullptr,
+    "Main polling interval, also the deadline of each control cycle"},
+  {"failsafe_timeout", UNSIGNED, false, false, "0",
+    "Seconds without a completed update after which fans are forced\n"
+    "  to max_pwm by an independent thread (0 disables)"},
+  {"io_backend", TEXT, false, false, "pread",
+    "Sensor access method\n  (pread or io_uring, falling back to pread\n"
+    "  when io_uring is not supported)"},
+  {"status_page", TEXT, false, false, STATUS_PAGE_PATH,
+    "Shared-memory file where channel values are published\n"
+    "  for fancontrolcpp-status and other readers (empty disables)"},
+  {"safe_start", BOOLEAN, false, false, "false",
+    "Put fans to max_pwm right at start, on the devices cached\n"
+    "  by the previous start when possible; off by default since\n"
+    "  every start, watchdog restarts included, then spins fans\n"
+    "  up to full speed"},
+
+  {"pwm_algorithm", TEXT, true, false, "quadratic",
+    "PWM adjusting function algorithm\n  (quadratic or linear)"},
+  {"poll_interval", UNSIGNED, true, false, nullptr,
+    "Polling interval of this channel\n  (defaults to poll_interval)"},
+  {"pwm_ctrl", TEXT, true, true, nullptr,
+    "PWM control device, as a path, chip:attribute\n  or label:text"},
+  {"fan_sensor", TEXT, true, true, nullptr,
+    "Fan rotation speed sensor device (idem)"},
+  {"temp_sensor", TEXT, true, true, nullptr,
+    "Temperature sensor device (idem)"},
+  {"min_temp", LONG, true, true, nullptr,
+    "Minimum temperature for PWM adjusting function"},
+  {"max_temp", LONG, true, true, nullptr,
+    "Maximum temperature for PWM adjusting function"},
+  {"temp_hyst", LONG, true, true, nullptr,
+    "Temperature hysteresis for fan stop/start"},
+  {"min_start", LONG, true, true, nullptr,
+    "Minimum PWM value to start fan rotation when stopped"},
+  {"min_stop", LONG, true, true, nullptr,
+    "PWM value applied at min_temp (must keep fan rotating)"},
+  {"min_speed", LONG, true, true, nullptr,
+    "Minimum fan rotation speed to consider it started"},
+  {"min_pwm", LONG, true, true, nullptr,
+    "Minimum allowed PWM value\n  (applied below min_temp)"},
+  {"max_pwm", LONG, true, true, nullptr,
+    "Maximum allowed PWM value\n  (applied at and after max_temp)"},
+  {"filters", TEXT, true, false, "legacy",
+    "PWM filtering pipeline\n  (legacy: progressive increase, or damped:\n"
+    "  ema_alpha, deadband, rise/fall_step, min_on/off)"},
+  {"ema_alpha", REAL, true, false, "1",
+    "Smoothing factor of computed PWM, in ]0, 1]\n  (damped filters)"},
+  {"deadband", LONG, true, false, "0",
+    "Ignore PWM changes smaller than this\n  (damped filters)"},
+  {"rise_step", LONG, true, false, "0",
+    "Maximum PWM increase per cycle, 0 for unlimited\n  (damped filters)"},
+  {"fall_step", LONG, true, false, "0",
+    "Maximum PWM decrease per cycle, 0 for unlimited\n  (damped filters)"},
+  {"min_on", UNSIGNED, true, false, "0",
+    "Minimum seconds a started fan is kept running\n  (damped filters)"},
+  {"min_off", UNSIGNED, true, false, "0",
+    "Minimum seconds a stopped fan is kept stopped\n  (damped filters)"},
+  {"feed_forward", TEXT, true, false, "none",
+    "Load source raising PWM ahead of temperature\n"
+    "  (none, cpu, cpufreq or rapl)"},
+  {"ff_gain", REAL, true, false, "64",
+    "PWM bias for a load jump from 0 to 1"},
+  {"ff_alpha", REAL, true, false, "0.1",
+    "Per-cycle factor with which the bias decays, in ]0, 1]"},
+  {"ff_full_power", REAL, true, false, "0",
+    "Package power in W considered as full load\n  (rapl source)"},
+  {"estimator", TEXT, true, false, "none",
+    "Temperature estimation before PWM computation\n  (none or kalman)"},
+  {"kalman_noise", REAL, true, false, "500",
+    "Standard deviation of temperature readings\n  (kalman estimator)"},
+  {"kalman_accel", REAL, true, false, "50",
+    "Standard deviation of temperature acceleration,\n"
+    "  per square second (kalman estimator)"},
+  {"predict_cycles", UNSIGNED, true, false, "0",
+    "Act on temperature predicted this many poll\n"
+    "  intervals ahead (kalman estimator, 0 to 2)"},
+  {"stall_detect", BOOLEAN, true, false, "false",
+    "Detect fan stalls, using fanN_alarm when fanN_min is set"},
+  {"stall_ratio", REAL, true, false, "0.5",
+    "Fraction of expected RPM under which the fan is\n"
+    "  considered stalled (without fanN_alarm)"},
+  {"group", TEXT, true, false, nullptr,
+    "Thermal group; fans of a group are run at full\n"
+    "  speed while one of them is stalled"},
+  {"recalibrate", TEXT, true, false, "none",
+    "Watch the live PWM to RPM curve for drift\n  (none, detect, or "
+    "reprobe: also probe again\n  min_start/min_stop when cool)"},
+  {"drift_threshold", REAL, true, false, "0.15",
+    "Relative RPM change considered a drift"},
+};
+
+const std::size_t option_count = sizeof(options) / sizeof(options[0]);
+
+const char CACHE_MAGIC[8] = {'F', 'C', 'C', 'O', 'N', 'F', '0', '2'};
+
+// Value slot of an option, channel being 1 to max_channels for channel ones
+std::size_t slot_of(std::size_t index, unsigned int channel) {
+  std::size_t slot = 0;
+  for (std::size_t i = 0; i < index; ++i)
+    slot += options[i].channel ? config::max_channels : 1;
+  return options[index].channel ? slot + channel - 1 : slot;
+}
+
+std::size_t slot_count() {
+  return slot_of(option_count - 1, config::max_channels) + 1;
+}
+
+// Option index and channel of a name like poll_interval or pwm_ctrl2
+bool lookup(const std::string &name, std::size_t * index,
+            unsigned int * channel) {
+  std::size_t digits = name.size();
+  while (digits > 0 && name[digits - 1] >= '0' && name[digits - 1] <= '9')
+    --digits;
+  for (std::size_t i = 0; i < option_count; ++i) {
+    if (!options[i].channel && name == options[i].name) {
+      *index = i;
+      *channel = 0;
+      return true;
+    }
+  }
+  if (digits == name.size() || digits == 0 || name.size() - digits > 2)
+    return false;
+  unsigned long n = std::strtoul(name.c_str() + digits, nullptr, 10);
+  if (n < 1 || n > config::max_channels)
+    return false;
+  const std::string base = name.substr(0, digits);
+  for (std::size_t i = 0; i < option_count; ++i) {
+    if (options[i].channel && base == options[i].name) {
+      *index = i;
+      *channel = static_cast<unsigned int>(n);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string trim(const std::string &s) {
+  const char * blanks = " \t\r";
+  std::size_t begin = s.find_first_not_of(blanks);
+  if (begin == std::string::npos)
+    return std::string();
+  return s.substr(begin, s.find_last_not_of(blanks) - begin + 1);
+}
+
+// Same signature, same table: the cache layout depends on it
+uint64_t table_signature() {
+  uint64_t hash = 14695981039346656037ULL;
+  auto mix = [&hash](const char * s, std::size_t len) {
+    for (std::size_t i = 0; i < len; ++i) {
+      hash ^= static_cast<unsigned char>(s[i]);
+      hash *= 1099511628211ULL;
+    }
+  };
+  for (const option & o : options) {
+    mix(o.name, std::strlen(o.name) + 1);
+    char flags[3] = {static_cast<char>(o.type), o.channel, o.required};
+    mix(flags, sizeof(flags));
+    if (o.default_value)
+      mix(o.default_value, std::strlen(o.default_value) + 1);
+  }
+  char channels = config::max_channels;
+  mix(&channels, 1);
+  return hash;
+}
+
+// Identity of the configuration file, empty when it cannot be stat'ed
+std::string file_identity(const std::string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0)
+    return std::string();
+  const int64_t fields[] = {
+    static_cast<int64_t>(table_signature()),
+    static_cast<int64_t>(st.st_dev), static_cast<int64_t>(st.st_ino),
+    static_cast<int64_t>(st.st_size),
+    static_cast<int64_t>(st.st_mtim.tv_sec),
+    static_cast<int64_t>(st.st_mtim.tv_nsec),
+  };
+  return std::string(reinterpret_cast<const char *>(fields), sizeof(fields)) +
+         path;
+}
+
+template<typename T>
+void put(std::string * out, T v) {
+  out->append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+template<typename T>
+bool take(const std::string &in, std::size_t * pos, T * v) {
+  if (in.size() - *pos < sizeof(T))
+    return false;
+  std::memcpy(v, in.data() + *pos, sizeof(T));
+  *pos += sizeof(T);
+  return true;
+}
+
+}  // namespace
+
+config::config() : values(slot_count()), from_cache(false) {
+  for (value & v : values) {
+    v.set = false;
+    v.integer = 0;
+    v.real = 0.0;
+  }
+}
+
+config config::load(const std::string &path, const std::string &cache_path) {
+  const std::string key =
+    cache_path.empty() ? std::string() : file_identity(path);
+  if (!key.empty()) {
+    config cached;
+    cached.cache_path = cache_path;
+    cached.cache_key = key;
+    if (cached.read_cache()) {
+      cached.from_cache = true;
+      return cached;
+    }
+  }
+  config c;
+  c.cache_path = cache_path;
+  c.cache_key = key;
+  c.parse(path);
+  c.set_defaults();
+  return c;
+}
+
+void config::parse(const std::string &path) {
+  std::ifstream in(path);
+  if (!in)
+    throw std::runtime_error("can not read options configuration file " +
+                             path);
+  std::string line;
+  for (unsigned int number = 1; std::getline(in, line); ++number) {
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty())
+      continue;
+    std::size_t equal = line.find('=');
+    if (equal == std::string::npos)
+      throw std::runtime_error("Syntax error at line " +
+                               std::to_string(number) + ": " + line);
+    set(trim(line.substr(0, equal)), trim(line.substr(equal + 1)), number);
+  }
+}
+
+void config::set(const std::string &name, const std::string &text,
+                 unsigned int line) {
+  std::size_t index;
+  unsigned int channel;
+  if (!lookup(name, &index, &channel))
+    throw std::runtime_error("Unknown option " + name +
+                             (line ? " at line " + std::to_string(line) : ""));
+  value & v = values[slot_of(index, channel)];
+  if (v.set)
+    throw std::runtime_error("Option " + name + " given more than once");
+
+  const char * begin = text.c_str();
+  char * end = nullptr;
+  bool ok = !text.empty();
+  errno = 0;
+  switch (options[index].type) {
+    case TEXT:
+      v.text = text;
+      ok = true;
+      break;
+    case LONG:
+      v.integer = std::strtol(begin, &end, 10);
+      break;
+    case UNSIGNED: {
+      unsigned long u = std::strtoul(begin, &end, 10);
+      ok = ok && text[0] != '-' && u <= UINT_MAX;
+      v.integer = static_cast<long>(u);
+      break;
+    }
+    case REAL:
+      v.real = std::strtod(begin, &end);
+      break;
+    case BOOLEAN:
+      if (text == "true" || text == "yes" || text == "on" || text == "1")
+        v.integer = 1;
+      else if (text == "false" || text == "no" || text == "off" ||
+               text == "0")
+        v.integer = 0;
+      else
+        ok = false;
+      break;
+  }
+  if (end)
+    ok = ok && !*end && errno != ERANGE;
+  if (!ok)
+    throw std::runtime_error("Invalid value " + text + " for option " + name);
+  v.set = true;
+}
+
+void config::set_defaults() {
+  for (std::size_t i = 0; i < option_count; ++i) {
+    if (!options[i].default_value)
+      continue;
+    const std::string name(options[i].name);
+    unsigned int channels = options[i].channel ? max_channels : 1;
+    for (unsigned int n = 1; n <= channels; ++n) {
+      if (values[slot_of(i, n)].set)
+        continue;
+      set(options[i].channel ? name + std::to_string(n) : name,
+          options[i].default_value, 0);
+    }
+  }
+}
+
+void config::validate() const {
+  if (from_cache)
+    return;
+  for (std::size_t i = 0; i < option_count; ++i) {
+    if (options[i].required && !options[i].channel &&
+        !values[slot_of(i, 0)].set)
+      throw std::runtime_error(std::string("Missing option ") +
+                               options[i].name);
+  }
+  // Channel 1 is mandatory, others are optional but must then be complete
+  for (unsigned int n = 1; n <= max_channels; ++n) {
+    const std::string suffix = std::to_string(n);
+    if (n > 1 && !count("pwm_ctrl" + suffix))
+      continue;
+    for (std::size_t i = 0; i < option_count; ++i) {
+      if (options[i].required && options[i].channel &&
+          !values[slot_of(i, n)].set)
+        throw std::runtime_error("Incomplete instance definition for "
+                                 "pwm_ctrl" + suffix + ": missing " +
+                                 options[i].name + suffix);
+    }
+  }
+}
+
+bool config::read_cache() {
+  std::ifstream in(cache_path, std::ios::binary);
+  if (!in)
+    return false;
+  std::string data((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  std::size_t pos = sizeof(CACHE_MAGIC);
+  uint32_t key_size;
+  if (data.size() < pos || data.compare(0, pos, CACHE_MAGIC, pos) != 0 ||
+      !take(data, &pos, &key_size) || key_size != cache_key.size() ||
+      data.compare(pos, key_size, cache_key) != 0)
+    return false;
+  pos += key_size;
+
+  for (std::size_t i = 0; i < option_count; ++i) {
+    unsigned int channels = options[i].channel ? max_channels : 1;
+    for (unsigned int n = 1; n <= channels; ++n) {
+      value & v = values[slot_of(i, n)];
+      uint8_t set;
+      if (!take(data, &pos, &set))
+        return false;
+      v.set = set;
+      if (!v.set)
+        continue;
+      int64_t integer;
+      uint32_t size;
+      switch (options[i].type) {
+        case TEXT:
+          if (!take(data, &pos, &size) || data.size() - pos < size)
+            return false;
+          v.text = data.substr(pos, size);
+          pos += size;
+          break;
+        case REAL:
+          if (!take(data, &pos, &v.real))
+            return false;
+          break;
+        default:
+          if (!take(data, &pos, &integer))
+            return false;
+          v.integer = static_cast<long>(integer);
+          break;
+      }
+    }
+  }
+  uint32_t pwm_count;
+  if (!take(data, &pos, &pwm_count))
+    return false;
+  for (uint32_t i = 0; i < pwm_count; ++i) {
+    uint32_t size;
+    int64_t max_pwm;
+    if (!take(data, &pos, &size) || data.size() - pos < size)
+      return false;
+    std::string device = data.substr(pos, size);
+    pos += size;
+    if (!take(data, &pos, &max_pwm))
+      return false;
+    safe_pwms.emplace_back(device, static_cast<long>(max_pwm));
+  }
+  return pos == data.size();
+}
+
+void config::save_cache(const pwm_list &pwms) const {
+  if (cache_key.empty() || (from_cache && pwms == safe_pwms))
+    return;
+  std::string data(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  put(&data, static_cast<uint32_t>(cache_key.size()));
+  data += cache_key;
+  for (std::size_t i = 0; i < option_count; ++i) {
+    unsigned int channels = options[i].channel ? max_channels : 1;
+    for (unsigned int n = 1; n <= channels; ++n) {
+      const value & v = values[slot_of(i, n)];
+      put(&data, static_cast<uint8_t>(v.set));
+      if (!v.set)
+        continue;
+      switch (options[i].type) {
+        case TEXT:
+          put(&data, static_cast<uint32_t>(v.text.size()));
+          data += v.text;
+          break;
+        case REAL:
+          put(&data, v.real);
+          break;
+        default:
+          put(&data, static_cast<int64_t>(v.integer));
+          break;
+      }
+    }
+  }
+  put(&data, static_cast<uint32_t>(pwms.size()));
+  for (const auto &pwm : pwms) {
+    put(&data, static_cast<uint32_t>(pwm.first.size()));
+    data += pwm.first;
+    put(&data, static_cast<int64_t>(pwm.second));
+  }
+
+  // Best effort, the cache only speeds up next start
+  std::size_t slash = cache_path.rfind('/');
+  if (slash != std::string::npos && slash > 0)
+    mkdir(cache_path.substr(0, slash).c_str(), 0755);
+  const std::string tmp_path = cache_path + ".new";
+  std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+  out.write(data.data(), static_cast<std::streamsize>(data.size()));
+  out.close();
+  if (!out || std::rename(tmp_path.c_str(), cache_path.c_str()) != 0)
+    std::remove(tmp_path.c_str());
+}
+
+const config::value & config::find(const std::string &name, int type) const {
+  std::size_t index;
+  unsigned int channel;
+  if (!lookup(name, &index, &channel) || options[index].type != type)
+    throw std::logic_error("No option " + name + " of this type!");
+  const value & v = values[slot_of(index, channel)];
+  if (!v.set)
+    throw std::runtime_error("Option " + name + " has no value!");
+  return v;
+}
+
+bool config::count(const std::string &name) const {
+  std::size_t index;
+  unsigned int channel;
+  return lookup(name, &index, &channel) &&
+         values[slot_of(index, channel)].set;
+}
+
+template<>
+std::string config::get<std::string>(const std::string &name) const {
+  return find(name, TEXT).text;
+}
+template<>
+long config::get<long>(const std::string &name) const {
+  return find(name, LONG).integer;
+}
+template<>
+unsigned int config::get<unsigned int>(const std::string &name) const {
+  return static_cast<unsigned int>(find(name, UNSIGNED).integer);
+}
+template<>
+double config::get<double>(const std::string &name) const {
+  return find(name, REAL).real;
+}
+template<>
+bool config::get<bool>(const std::string &name) const {
+  return find(name, BOOLEAN).integer != 0;
+}
+
+void config::print_help(std::ostream &out) {
+  const int width = 30;
+  out << "Configuration file parameters (N from 1 to " << max_channels
+      << ", channel 1 mandatory):\n";
+  for (const option & o : options) {
+    std::string label = std::string("  ") + o.name + (o.channel ? "N" : "");
+    if (o.default_value)
+      label += std::string(" (=") + o.default_value + ")";
+    out << std::left << std::setw(width) << label;
+    if (static_cast<int>(label.size()) >= width)
+      out << "\n" << std::string(width, ' ');
+    std::istringstream help(o.help);
+    std::string line;
+    bool first = true;
+    while (std::getline(help, line)) {
+      if (!first)
+        out << std::string(width, ' ');
+      out << line << "\n";
+      first = false;
+    }
+  }
+}
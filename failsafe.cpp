@@ -0,0 +1,85 @@
+#include "lib/failsafe.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include "lib/probes.h"
+
+failsafe::failsafe(unsigned int timeout)
+  : timeout(timeout), trips(0), stop_request(false) {
+  if (!timeout)
+    throw std::runtime_error("Failsafe timeout must be positive!");
+}
+
+failsafe::~failsafe() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop_request = true;
+  }
+  cv.notify_all();
+  if (thread.joinable())
+    thread.join();
+  for (auto & ch : channels)
+    close(ch->fd);
+}
+
+std::size_t failsafe::add(const std::string &controller, long max_pwm) {
+  if (thread.joinable())
+    throw std::logic_error("Cannot add failsafe channel once started!");
+  int fd = open(controller.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Could not open PWM device " + controller +
+                             " for failsafe!");
+  std::unique_ptr<channel> ch(new channel);
+  ch->controller = controller;
+  ch->fd = fd;
+  ch->max_pwm = std::to_string(max_pwm);
+  ch->last_kick = clock::now().time_since_epoch().count();
+  ch->tripped = false;
+  channels.push_back(std::move(ch));
+  return channels.size() - 1;
+}
+
+void failsafe::start() {
+  thread = std::thread(&failsafe::run, this);
+}
+
+void failsafe::kick(std::size_t index) {
+  channels[index]->last_kick = clock::now().time_since_epoch().count();
+}
+
+void failsafe::run() {
+  const clock::duration limit = std::chrono::seconds(timeout);
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!cv.wait_for(lock, std::chrono::seconds(1),
+                      [this] { return stop_request; })) {
+    clock::time_point now = clock::now();
+    for (auto & ch : channels) {
+      clock::time_point last(clock::duration(ch->last_kick.load()));
+      if (now - last <= limit) {
+        ch->tripped = false;
+      } else {
+        // Again on every tick, in case the stuck loop writes the PWM
+        trip(ch.get(), !ch->tripped);
+        ch->tripped = true;
+      }
+    }
+  }
+}
+
+void failsafe::trip(channel * ch, bool first) {
+  if (first) {
+    ++trips;
+    FC_PROBE1(failsafe_trip, ch->controller.c_str());
+    std::cerr << "Failsafe: " << ch->controller << " not updated for over "
+              << timeout << "s, forcing " << ch->max_pwm << std::endl;
+  }
+  if (pwrite(ch->fd, ch->max_pwm.data(), ch->max_pwm.size(), 0) < 0 && first)
+    std::cerr << "Failsafe: unable to write " << ch->controller << ": "
+              << std::strerror(errno) << std::endl;
+}
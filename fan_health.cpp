@@ -0,0 +1,99 @@
+#include "lib/fan_health.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+static const std::string INPUT_SUFFIX("_input");
+
+fan_health::fan_health(const std::string &fan_sensor, long min_stop,
+                       long min_speed, double stall_ratio)
+  : min_stop(min_stop), min_speed(min_speed), stall_ratio(stall_ratio),
+    alarm_fd(-1), alarm(-1), speed_unread(false), unread_cycles(0),
+    last_pwm(0), reference_pwm(min_stop),
+    reference_speed(min_speed) {
+  // fanN_input -> fanN_alarm, when the chip has one. It means
+  // fanN_input < fanN_min, which is often left at 0: no alarm then.
+  std::size_t pos = fan_sensor.rfind(INPUT_SUFFIX);
+  if (pos != std::string::npos &&
+      pos + INPUT_SUFFIX.size() == fan_sensor.size()) {
+    const std::string base = fan_sensor.substr(0, pos);
+    long fan_min = 0;
+    std::ifstream(base + "_min") >> fan_min;
+    if (fan_min > 0) {
+      alarm_path = base + "_alarm";
+      alarm_fd = open(alarm_path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+  }
+}
+
+fan_health::~fan_health() {
+  if (alarm_fd >= 0)
+    close(alarm_fd);
+}
+
+bool fan_health::read_alarm() const {
+  char buf[16];
+  ssize_t len = pread(alarm_fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0)
+    throw std::runtime_error("Unable to read " + alarm_path + "!");
+  buf[len] = '\0';
+  return std::strtol(buf, nullptr, 10) != 0;
+}
+
+void fan_health::set_limits(long new_min_stop, long new_min_speed) {
+  min_stop = new_min_stop;
+  min_speed = new_min_speed;
+  reference_pwm = min_stop;
+  reference_speed = min_speed;
+}
+
+long fan_health::expected_speed(long pwm) const {
+  if (pwm >= reference_pwm || reference_pwm <= min_stop)
+    return reference_speed;
+  return min_speed + (reference_speed - min_speed) * (pwm - min_stop) /
+                     (reference_pwm - min_stop);
+}
+
+bool fan_health::needs_speed(long pwm) {
+  alarm = -1;
+  speed_unread = false;
+  if (!has_alarm() || pwm < min_stop || last_pwm < min_stop)
+    return true;
+  alarm = read_alarm();
+  if (alarm || ++unread_cycles >= max_unread_cycles) {
+    unread_cycles = 0;
+    return true;
+  }
+  speed_unread = true;
+  return false;
+}
+
+bool fan_health::check(long pwm, long fan_speed) {
+  // Let the fan spin up for one cycle after being (re)started
+  bool settled = pwm >= min_stop && last_pwm >= min_stop;
+  last_pwm = pwm;
+  const int known_alarm = alarm;
+  const bool fresh_speed = !speed_unread;
+  alarm = -1;
+  speed_unread = false;
+  if (!settled)
+    return false;
+
+  bool stalled;
+  if (has_alarm())
+    stalled = !fan_speed ||
+              (known_alarm >= 0 ? known_alarm != 0 : read_alarm());
+  else
+    stalled = fan_speed < stall_ratio * expected_speed(pwm);
+
+  // Only from fresh readings
+  if (!stalled && fresh_speed && pwm >= reference_pwm) {
+    reference_pwm = pwm;
+    reference_speed = fan_speed;
+  }
+  return stalled;
+}
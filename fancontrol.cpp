@@ -1,14 +1,34 @@
+#include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <time.h>
 #include <systemd/sd-daemon.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <csignal>
-#include <cmath>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <iostream>
 #include <string>
-#include <boost/program_options.hpp>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "lib/pidfile.h"
+#include "lib/channel_status.h"
+#include "lib/config.h"
+#include "lib/failsafe.h"
+#include "lib/fan_health.h"
 #include "lib/fancontroller.h"
+#include "lib/hwmon_index.h"
+#include "lib/load_monitor.h"
+#include "lib/pwm_computer.h"
+#include "lib/probes.h"
+#include "lib/pwm_filters.h"
+#include "lib/rpm_model.h"
+#include "lib/status_page.h"
 
 /*
  * TODO:
@@ -16,11 +36,22 @@
  * Check/implement hysteresis for fan stop/start on low temperatures
  */
 
-namespace bpo = boost::program_options;
-
-static bool shutdown_request = false;
+static volatile sig_atomic_t shutdown_request = false;
 static bool verbose = false;
 
+typedef std::chrono::steady_clock loop_clock;
+
+// Sleep until deadline; return false if interrupted, like sleep() does
+static bool sleep_until(loop_clock::time_point deadline) {
+  auto since_epoch = deadline.time_since_epoch();
+  auto secs = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+  struct timespec ts;
+  ts.tv_sec = secs.count();
+  ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      since_epoch - secs).count();
+  return !clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+}
+
 static void signal_handler(int signum) {
   switch (signum) {
     case SIGINT:
@@ -39,465 +70,859 @@ static void signal_handler(int signum) {
   }
 }
 
-class pwm_computer {
- public:
-  explicit pwm_computer(const fancontroller * const fc);
-  virtual ~pwm_computer() {}
-  long pwm_for(long temperature) const;
-  virtual long calculate(long temperature) const = 0;
- protected:
-  const long double min_temperature, max_temperature,
-                    min_pwm, min_stop, max_pwm;
+struct channel {
+  unsigned int id;
+  std::unique_ptr<fancontroller> fc;
+  std::unique_ptr<pwm_computer> computer;
+  std::unique_ptr<load_monitor> load;
+  std::unique_ptr<fan_health> health;
+  std::unique_ptr<drift_monitor> drift;
+  bool reprobe;
+  loop_clock::time_point reprobe_after;  // After an aborted probe
+  // Other channels of the same thermal group, boosted on stall
+  std::vector<channel *> siblings;
+  loop_clock::duration period;
+  failsafe * fs;
+  std::size_t failsafe_index;
+  status_page * page;
+  unsigned int page_index;
+  channel_status status;
+  std::thread worker;
 };
-pwm_computer::pwm_computer(const fancontroller * const fc)
-  : min_temperature(static_cast<long double>(fc->get_min_temp())),
-    max_temperature(static_cast<long double>(fc->get_max_temp())),
-    min_pwm(static_cast<long double>(fc->get_min_pwm())),
-    min_stop(static_cast<long double>(fc->get_min_stop())),
-    max_pwm(static_cast<long double>(fc->get_max_pwm())) {}
-long pwm_computer::pwm_for(long temperature) const {
-  if (temperature < min_temperature)  // TODO: add hysteresis
-    return static_cast<double>(min_pwm);
-  else if (temperature > max_temperature)
-    return static_cast<double>(max_pwm);
-  else
-    return calculate(temperature);
-}
 
-class linear_pwm_computer : public pwm_computer {
- public:
-  explicit linear_pwm_computer(const fancontroller * const fc);
-  ~linear_pwm_computer() {}
-  long calculate(long temperature) const;
- private:
-  const long double a, b;
-};
-linear_pwm_computer::linear_pwm_computer(const fancontroller * const fc)
-  : pwm_computer(fc),
-    a((max_pwm - min_stop) / (max_temperature - min_temperature)),
-    b((min_stop + max_pwm - a * (min_temperature + max_temperature)) / 2.0L) {}
-long linear_pwm_computer::calculate(long temperature) const {
-  return static_cast<long>(a * static_cast<long double>(temperature) + b);
+// Shared by workers so that shutdown interrupts their sleep
+static std::mutex workers_mutex;
+static std::condition_variable workers_cv;
+static bool workers_stop = false;
+
+// Flag or clear a stall, and boost or release the thermal group siblings
+static void set_stalled(channel * ch, bool stalled, long pwm, long fan_speed) {
+  ch->status.stalled = stalled;
+  if (stalled) {
+    ++ch->status.stalls;
+    long expected = ch->health->expected_speed(pwm);
+    std::cerr << "FC" << ch->id << ": fan stall detected, " << fan_speed
+              << " RPM at PWM " << pwm << " (expected " << expected << ")"
+              << std::endl;
+    sd_notifyf(0, "STATUS=FC%u fan stall detected: %ld RPM at PWM %ld "
+        "(expected %ld), boosting %zu sibling fans",
+        ch->id, fan_speed, pwm, expected, ch->siblings.size());
+  } else {
+    std::cerr << "FC" << ch->id << ": fan running again" << std::endl;
+    sd_notifyf(0, "STATUS=FC%u fan running again", ch->id);
+  }
+  for (channel * sibling : ch->siblings) {
+    if (stalled)
+      ++sibling->status.boost_requests;
+    else
+      --sibling->status.boost_requests;
+  }
+  // Wake siblings up now rather than at their next cycle
+  { std::lock_guard<std::mutex> lock(workers_mutex); }
+  workers_cv.notify_all();
 }
 
-class quadratic_pwm_computer : public pwm_computer {
- public:
-  explicit quadratic_pwm_computer(const fancontroller * const fc);
-  ~quadratic_pwm_computer() {}
-  long calculate(long temperature) const;
- private:
-  const long double a, b, c;
-};
-quadratic_pwm_computer::quadratic_pwm_computer(const fancontroller * const fc)
-  : pwm_computer(fc),
-    a((max_pwm - min_stop) / pow(max_temperature - min_temperature, 2.0L)),
-    b(-2.0L * min_temperature * a),
-    c((min_stop + max_pwm +
-       a * (pow(min_temperature + max_temperature, 2.0L) -
-            2.0L * pow(max_temperature, 2.0L))) / 2.0L) {}
-long quadratic_pwm_computer::calculate(long temperature) const {
-  return static_cast<long>(
-      a * std::pow(static_cast<long double>(temperature), 2.0L)
-    + b * static_cast<long double>(temperature)
-    + c);
+// Wait a second during a probe or a fan start, keeping the channel known as
+// alive to the failsafe and the supervisor. Returns why the wait was cut
+// short: shutdown, or with yield_to_boost a sibling fan stall; else nullptr.
+static const char * probe_wait(channel * ch, bool yield_to_boost) {
+  std::unique_lock<std::mutex> lock(workers_mutex);
+  if (workers_cv.wait_for(lock, std::chrono::seconds(1), [ch, yield_to_boost] {
+        return workers_stop ||
+          (yield_to_boost && ch->status.boost_requests > 0);
+      }))
+    return workers_stop ? "shutting down" : "sibling fan stalled";
+  lock.unlock();
+  if (ch->fs)
+    ch->fs->kick(ch->failsafe_index);
+  ch->status.mark_on_time(loop_clock::now());
+  return nullptr;
 }
 
-static void update(fancontroller * fc, const pwm_computer * compute, const long temp_hyst) {
-  long temp  = fc->read_temperature();
-  long cur_pwm = fc->read_fan_pwm();
-  long cur_fan_speed = fc->read_fan_speed();
+// Give up on probing: put the fan back to pwm, and either retry later or,
+// when the probe showed the fan needs a full calibration, stop reprobing
+static void reprobe_abort(channel * ch, long pwm, const char * reason,
+                          bool retry) {
+  const loop_clock::duration retry_delay = std::chrono::minutes(30);
 
-  // Hysteresis
-  if (!cur_fan_speed) {
-    temp -= temp_hyst;
+  ch->fc->set_fan_pwm(pwm);
+  if (retry) {
+    ch->reprobe_after = loop_clock::now() + retry_delay;
+    std::cerr << "FC" << ch->id << ": threshold probe aborted, " << reason
+              << std::endl;
+    sd_notifyf(0, "STATUS=FC%u threshold probe aborted, %s", ch->id, reason);
+  } else {
+    ch->reprobe = false;
+    std::cerr << "FC" << ch->id << ": " << reason
+              << ", full calibration needed" << std::endl;
+    sd_notifyf(0, "STATUS=FC%u %s, full calibration needed", ch->id, reason);
   }
+}
 
-  // Compute regular new PWM value
-  long computed_pwm = compute->pwm_for(temp);
-#if defined(MY_DEBUG)
-  std::cout << "Computed: " << computed_pwm;
-#endif
+// Short probe of min_stop, min_speed and min_start from the PWM of the
+// running fan, like calibrate-fancontrolcpp does over the whole PWM range.
+// Given up as soon as temperature rises by more than probe_max_rise.
+static void reprobe(channel * ch, long cur_pwm) {
+  const int probe_max_steps = 64;
+  const long probe_max_rise = 5000;
+
+  fancontroller * fc = ch->fc.get();
+  const long max_temp = std::min(fc->get_max_temp(),
+                                 fc->read_temperature() + probe_max_rise);
+  std::cerr << "FC" << ch->id << ": probing start/stop thresholds again"
+            << std::endl;
+  sd_notifyf(0, "STATUS=FC%u drifted by %.0f%%, probing start/stop thresholds",
+      ch->id, 100.0 * ch->drift->get_drift());
+
+  // Downward from current PWM to fan stop
+  long pwm = cur_pwm;
+  long min_stop = -1, min_speed = 0;
+  bool stopped = false;
+  for (int step = 0; step < probe_max_steps && pwm >= fc->get_min_pwm();
+       ++step, --pwm) {
+    fc->set_fan_pwm(pwm);
+    if (const char * reason = probe_wait(ch, true)) {
+      reprobe_abort(ch, cur_pwm, reason, true);
+      return;
+    }
+    if (fc->read_temperature() >= max_temp) {
+      reprobe_abort(ch, cur_pwm, "temperature rising", true);
+      return;
+    }
+    long fan_speed = fc->read_fan_speed();
+    FC_PROBE3(reprobe_step, ch->id, pwm, fan_speed);
+    if (!fan_speed) {
+      stopped = true;
+      break;
+    }
+    min_stop = pwm;
+    min_speed = fan_speed;
+  }
+  if (min_stop < 0) {
+    reprobe_abort(ch, cur_pwm, "fan stopped at once", false);
+    return;
+  }
+  // Still spinning: inconclusive at min_pwm, too far from it otherwise
+  if (!stopped && pwm < fc->get_min_pwm()) {
+    reprobe_abort(ch, cur_pwm, "inconclusive probe, fan still spinning at "
+                  "min_pwm", false);
+    return;
+  }
+  if (!stopped) {
+    reprobe_abort(ch, cur_pwm, "fan stop not reached", true);
+    return;
+  }
 
-  // Filter it
-  // progressive and growing increase, unlimited decrease
-  long new_pwm = fc->get_min_start();
-  if (computed_pwm > cur_pwm) {
-    fc->up_step += 1;
-    new_pwm = cur_pwm + fc->up_step;
-    if (new_pwm >= computed_pwm) {
-      new_pwm = computed_pwm;
-      fc->up_step = 0;
+  // Upward from there to fan start
+  bool started = false;
+  for (int step = 0; step < probe_max_steps && pwm <= fc->get_max_pwm();
+       ++step, ++pwm) {
+    fc->set_fan_pwm(pwm);
+    if (const char * reason = probe_wait(ch, true)) {
+      reprobe_abort(ch, cur_pwm, reason, true);
+      return;
+    }
+    if (fc->read_temperature() >= max_temp) {
+      reprobe_abort(ch, cur_pwm, "temperature rising", true);
+      return;
     }
+    long fan_speed = fc->read_fan_speed();
+    FC_PROBE3(reprobe_step, ch->id, pwm, fan_speed);
+    if (fan_speed) {
+      started = true;
+      break;
+    }
+  }
+  if (!started) {
+    reprobe_abort(ch, fc->get_max_pwm(), "fan did not start again", false);
+    return;
+  }
+  const long min_start = pwm;
+
+  std::cerr << "FC" << ch->id << " recalibrated:"
+            << " min_start " << fc->get_min_start() << " -> " << min_start
+            << ", min_stop " << fc->get_min_stop() << " -> " << min_stop
+            << ", min_speed " << fc->get_min_speed() << " -> " << min_speed
+            << std::endl;
+  sd_notifyf(0, "STATUS=FC%u recalibrated: min_start=%ld min_stop=%ld "
+      "min_speed=%ld",
+      ch->id, min_start, min_stop, min_speed);
+  fc->set_min_start(min_start);
+  fc->set_min_stop(min_stop);
+  fc->set_min_speed(min_speed);
+  ch->computer->retune(min_stop);
+  if (ch->health)
+    ch->health->set_limits(min_stop, min_speed);
+  ch->drift->rebaseline(min_stop, min_speed);
+  ch->status.drifted = false;
+  ++ch->status.recalibrations;
+}
+
+template<typename Pipeline>
+static void update(channel * ch, Pipeline & pipeline) {
+  fancontroller * fc = ch->fc.get();
+  channel_status * status = &ch->status;
+  filter_sample sample;
+  // A running fan watched through fanN_alarm keeps its last RPM reading
+  // while the alarm is clear, unless drift monitoring needs fresh ones;
+  // status only ever shows an actual reading
+  bool fresh_speed = true;
+  if (ch->health && ch->health->has_alarm() && !ch->drift &&
+      status->fan_speed) {
+    fc->read_state(&sample.temperature, &sample.cur_pwm, nullptr);
+    fresh_speed = ch->health->needs_speed(sample.cur_pwm);
+    sample.fan_speed = fresh_speed ?
+      fc->read_fan_speed() : status->fan_speed.load();
   } else {
-    new_pwm = computed_pwm;
-    fc->up_step = 0;
+    fc->read_state(&sample.temperature, &sample.cur_pwm, &sample.fan_speed);
   }
+  FC_PROBE4(update_read, ch->id, sample.temperature, sample.cur_pwm,
+            sample.fan_speed);
+  status->temperature = sample.temperature;
+  if (fresh_speed)
+    status->fan_speed = sample.fan_speed;
+  sample.now = std::chrono::duration<double>(
+      loop_clock::now().time_since_epoch()).count();
+  sample.temp_rate = 0.0;
+  sample.computed = 0;
+  sample.pwm = 0;
+  sample.min_stop = fc->get_min_stop();
+  sample.load = ch->load ? ch->load->sample() : 0.0;
+
+  if (ch->health) {
+    bool stalled = ch->health->check(sample.cur_pwm, sample.fan_speed);
+    if (stalled != status->stalled)
+      set_stalled(ch, stalled, sample.cur_pwm, sample.fan_speed);
+  }
+
+  if (ch->drift && !status->stalled && !status->boost_requests) {
+    bool drifted = ch->drift->observe(sample.cur_pwm, sample.fan_speed);
+    if (drifted && !status->drifted) {
+      status->drifted = true;
+      std::cerr << "FC" << ch->id << ": PWM to RPM curve drifted by "
+                << static_cast<int>(100.0 * ch->drift->get_drift()) << "%"
+                << std::endl;
+      sd_notifyf(0, "STATUS=FC%u PWM to RPM curve drifted by %.0f%%",
+          ch->id, 100.0 * ch->drift->get_drift());
+    }
+    // Safe moment: cool enough for the curve to ask for its minimum anyway
+    if (drifted && ch->reprobe && sample.fan_speed &&
+        sample.temperature < fc->get_min_temp() &&
+        loop_clock::now() >= ch->reprobe_after) {
+      reprobe(ch, sample.cur_pwm);
+      return;
+    }
+  }
+
+  // Compute and filter new PWM value
+  long new_pwm = pipeline(sample);
+  FC_PROBE3(update_computed, ch->id, sample.temperature, sample.computed);
+  FC_PROBE2(update_filtered, ch->id, new_pwm);
+  if (!new_pwm && sample.computed)
+    FC_PROBE2(update_zeroed, ch->id, sample.computed);
 #if defined(MY_DEBUG)
-  std::cout << ", Filtered: " << new_pwm;
+  std::cout << "Filtered: " << new_pwm;
 #endif
 
-  // Would not start; zero value, but increase up_step to avoid staying for too long stopped if it should be normally running
-  if (!cur_fan_speed && new_pwm < fc->get_min_stop()) {
-    new_pwm = 0;
-    fc->up_step *= 2;
+  // Full speed for a stalled fan, or to compensate for a stalled sibling
+  if (status->stalled || status->boost_requests) {
+    new_pwm = fc->get_max_pwm();
+    FC_PROBE2(update_boosted, ch->id, new_pwm);
 #if defined(MY_DEBUG)
-    std::cout << ", Zeroed";
+    std::cout << ", Boosted";
 #endif
   }
 
-  // Ensure fan start if necessary
-  if (new_pwm && !cur_fan_speed) {
+  // Ensure fan start if necessary; not for a boosted one, max_pwm is
+  // written at once, nor for a stalled one, it would only ramp slowly up
+  // to failing
+  bool started = false;
+  if (new_pwm && !sample.fan_speed && !status->stalled &&
+      !status->boost_requests) {
     std::cout << "Starting fan" << std::endl;
-    fc->start_fan();
+    FC_PROBE2(update_start, ch->id, new_pwm);
+    fc->start_fan([ch] { return !probe_wait(ch, false); });
+    started = true;
   }
 
-  // Apply
+  // Apply, sparing the write when nothing changes
+  if (started || new_pwm != sample.cur_pwm) {
 #if defined(MY_DEBUG)
-  std::cout << ", Applying" << std::endl;
+    std::cout << ", Applying";
 #endif
-  fc->set_fan_pwm(new_pwm);
+    fc->set_fan_pwm(new_pwm);
+    FC_PROBE2(update_applied, ch->id, new_pwm);
+  }
+#if defined(MY_DEBUG)
+  std::cout << std::endl;
+#endif
+  status->pwm = new_pwm;
 }
 
-static bpo::variables_map parse_parameters(int argc, char **argv) {
-  std::string conf_file("/etc/fancontrol_cpp");
+// Copy channel values to the shared-memory status page
+static void publish_status(const channel * ch) {
+  const channel_status & status = ch->status;
+  status_snapshot s;
+  s.id = ch->id;
+  s.flags = (status.faulted ? STATUS_FAULTED : 0) |
+            (status.stalled ? STATUS_STALLED : 0) |
+            (status.drifted ? STATUS_DRIFTED : 0) |
+            (status.boost_requests ? STATUS_BOOSTED : 0);
+  s.temperature = status.temperature;
+  s.fan_speed = status.fan_speed;
+  s.pwm = status.pwm;
+  s.cycles = status.cycles;
+  s.overruns = status.overruns;
+  s.faults = status.faults;
+  s.stalls = status.stalls;
+  s.recalibrations = status.recalibrations;
+  ch->page->publish(ch->page_index, s);
+}
 
-  bpo::variables_map parameters;
+// Control loop of a single channel, run on its own thread.
+// Errors only affect this channel, which is put at full speed until its
+// sensors can be read again.
+template<typename Pipeline>
+static void run_channel(channel * ch, Pipeline pipeline) {
+  loop_clock::time_point deadline = loop_clock::now();
+  std::unique_lock<std::mutex> lock(workers_mutex);
+  while (!workers_stop) {
+    lock.unlock();
+    deadline += ch->period;
+    FC_PROBE1(cycle_begin, ch->id);
+
+    try {
+      update(ch, pipeline);
+      if (ch->status.faulted) {
+        ch->status.faulted = false;
+        std::cerr << "FC" << ch->id << " recovered" << std::endl;
+      }
+      if (ch->fs)
+        ch->fs->kick(ch->failsafe_index);
+    } catch (const std::runtime_error & e) {
+      ++ch->status.faults;
+      ch->status.faulted = true;
+      std::cerr << "FC" << ch->id << ": got error with update(): "
+                << e.what() << std::endl;
+      try {
+        ch->fc->set_full_speed();
+      } catch (const std::runtime_error & e) {
+        std::cerr << "FC" << ch->id << ": unable to restore full speed: "
+                  << e.what() << std::endl;
+      }
+    }
 
-  bpo::options_description cli_desc("Command-line options");
-  cli_desc.add_options()
-    ("help,h", "Print this help")
-    ("help-conf", "Print configuration file help")
-    ("verbose,v", "Verbose mode")
-    ("config-file,c", bpo::value<std::string>(&conf_file),
-       "Path to configuration file");
-  try {
-    bpo::store(bpo::parse_command_line(argc, argv, cli_desc), parameters);
-    bpo::notify(parameters);
-  } catch (bpo::error & e) {
-    std::cerr << e.what() << "\n" << cli_desc << std::endl;
-    sd_notifyf(0, "STATUS=Failed to parse command-line parameters: %s\n"
-        "STOPPING=1",
-        e.what());
-    exit(1);
+    ++ch->status.cycles;
+    loop_clock::time_point end = loop_clock::now();
+    if (end > deadline) {
+      ++ch->status.overruns;
+      std::cerr << "FC" << ch->id << ": control cycle overran its deadline by "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(
+                       end - deadline).count()
+                << "ms" << std::endl;
+      FC_PROBE2(cycle_done, ch->id,
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    end - deadline).count());
+      // Do not try to catch up, restart the schedule a full period from now
+      deadline = end + ch->period;
+    } else {
+      FC_PROBE2(cycle_done, ch->id, 0);
+      ch->status.mark_on_time(end);
+    }
+    if (ch->page)
+      publish_status(ch);
+
+    // Also wake up early when a sibling fan starts or stops stalling
+    const bool boosted = ch->status.boost_requests > 0;
+    lock.lock();
+    workers_cv.wait_until(lock, deadline, [ch, boosted] {
+      return workers_stop || (ch->status.boost_requests > 0) != boosted;
+    });
   }
+}
 
-  bpo::options_description file_desc("Configuration file parameters");
-  file_desc.add_options()
-    ("poll_interval", bpo::value<unsigned int>()->required(),
-       "Main polling interval")
-    // First instance, mandatory
-    ("pwm_algorithm1", bpo::value<std::string>()->default_value("quadratic"),
-       "PWM adjusting function algorithm\n  (quadratic or linear)")
-    ("pwm_ctrl1", bpo::value<std::string>()->required(),
-       "PWM control device")
-    ("fan_sensor1", bpo::value<std::string>()->required(),
-       "Fan rotation speed sensor device")
-    ("temp_sensor1", bpo::value<std::string>()->required(),
-       "Temperature sensor device")
-    ("min_temp1", bpo::value<long>()->required(),
-       "Minimum temperature for PWM adjusting function")
-    ("max_temp1", bpo::value<long>()->required(),
-       "Maximum temperature for PWM adjusting function")
-    ("temp_hyst1", bpo::value<long>()->required(),
-       "Temperature hysteresis for fan stop/start")
-    ("min_start1", bpo::value<long>()->required(),
-       "Minimum PWM value to start fan rotation when stopped")
-    ("min_stop1", bpo::value<long>()->required(),
-       "PWM value applied at min_temp (must keep fan rotating)")
-    ("min_speed1", bpo::value<long>()->required(),
-       "Minimum fan rotation speed to consider it started")
-    ("min_pwm1", bpo::value<long>()->required(),
-       "Minimum allowed PWM value\n  (applied below min_temp)")
-    ("max_pwm1", bpo::value<long>()->required(),
-       "Maximum allowed PWM value\n  (applied at and after max_temp)")
-    // Up to 2 other instances, optional
-    ("pwm_algorithm2", bpo::value<std::string>()->default_value("quadratic"),
-       "PWM adjusting function algorithm\n  (quadratic or linear)")
-    ("pwm_ctrl2", bpo::value<std::string>(),
-       "PWM control device")
-    ("fan_sensor2", bpo::value<std::string>(),
-       "Fan rotation speed sensor device")
-    ("temp_sensor2", bpo::value<std::string>(),
-       "Temperature sensor device")
-    ("min_temp2", bpo::value<long>(),
-       "Minimum temperature for PWM adjusting function")
-    ("max_temp2", bpo::value<long>(),
-       "Maximum temperature for PWM adjusting function")
-    ("temp_hyst2", bpo::value<long>(),
-       "Temperature hysteresis for fan stop/start")
-    ("min_start2", bpo::value<long>(),
-       "Minimum PWM value to start fan rotation when stopped")
-    ("min_stop2", bpo::value<long>(),
-       "PWM value applied at min_temp (must keep fan rotating)")
-    ("min_speed2", bpo::value<long>(),
-       "Minimum fan rotation speed to consider it started")
-    ("min_pwm2", bpo::value<long>(),
-       "Minimum allowed PWM value\n  (applied below min_temp)")
-    ("max_pwm2", bpo::value<long>(),
-       "Maximum allowed PWM value\n  (applied at and after max_temp)")
-    // the last...
-    ("pwm_algorithm3", bpo::value<std::string>()->default_value("quadratic"),
-       "PWM adjusting function algorithm\n  (quadratic or linear)")
-    ("pwm_ctrl3", bpo::value<std::string>(),
-       "PWM control device")
-    ("fan_sensor3", bpo::value<std::string>(),
-       "Fan rotation speed sensor device")
-    ("temp_sensor3", bpo::value<std::string>(),
-       "Temperature sensor device")
-    ("min_temp3", bpo::value<long>(),
-       "Minimum temperature for PWM adjusting function")
-    ("max_temp3", bpo::value<long>(),
-       "Maximum temperature for PWM adjusting function")
-    ("temp_hyst3", bpo::value<long>(),
-       "Temperature hysteresis for fan stop/start")
-    ("min_start3", bpo::value<long>(),
-       "Minimum PWM value to start fan rotation when stopped")
-    ("min_stop3", bpo::value<long>(),
-       "PWM value applied at min_temp (must keep fan rotating)")
-    ("min_speed3", bpo::value<long>(),
-       "Minimum fan rotation speed to consider it started")
-    ("min_pwm3", bpo::value<long>(),
-       "Minimum allowed PWM value\n  (applied below min_temp)")
-    ("max_pwm3", bpo::value<long>(),
-       "Maximum allowed PWM value\n  (applied at and after max_temp)");
-  try {
-    std::cerr << "Reading parameters from " << conf_file << std::endl;
-    bpo::store(bpo::parse_config_file<char>(conf_file.c_str(), file_desc),
-               parameters);
-    bpo::notify(parameters);
-  } catch (bpo::error & e) {
-    std::cerr << e.what() << "\n" << file_desc << std::endl;
-    sd_notifyf(0, "STATUS=Failed to parse configuration file: %s\n"
-        "STOPPING=1",
-        e.what());
-    exit(1);
+// Start the worker of a channel with the filter pipeline chosen in its
+// configuration; each pipeline is a distinct type, fully inlined in its
+// own run_channel() instance
+static void start_worker(channel * ch,
+                         const config & parameters) {
+  const std::string n = std::to_string(ch->id);
+  const std::string filters = parameters.get<std::string>("filters" + n);
+  estimator_filter estimator(
+      parameters.get<std::string>("estimator" + n) == "kalman",
+      parameters.get<double>("kalman_noise" + n),
+      parameters.get<double>("kalman_accel" + n),
+      parameters.get<unsigned int>("predict_cycles" + n) *
+        std::chrono::duration<double>(ch->period).count());
+  hysteresis_filter hysteresis(parameters.get<long>("temp_hyst" + n));
+  curve_filter curve(&ch->computer->get_curve());
+  feed_forward_filter feed_forward(
+      ch->load ? parameters.get<double>("ff_gain" + n) : 0.0,
+      parameters.get<double>("ff_alpha" + n), ch->fc->get_max_pwm());
+
+  if (filters == "damped") {
+    damped_pipeline pipeline(estimator, hysteresis, curve,
+        ema_filter(parameters.get<double>("ema_alpha" + n)),
+        deadband_filter(parameters.get<long>("deadband" + n)),
+        slew_filter(parameters.get<long>("rise_step" + n),
+                    parameters.get<long>("fall_step" + n)),
+        feed_forward, stop_filter(),
+        min_on_off_filter(parameters.get<unsigned int>("min_on" + n),
+                          parameters.get<unsigned int>("min_off" + n)));
+    ch->worker = std::thread(run_channel<damped_pipeline>, ch, pipeline);
+  } else {
+    legacy_pipeline pipeline(estimator, hysteresis, curve, ramp_filter(),
+                             feed_forward);
+    ch->worker = std::thread(run_channel<legacy_pipeline>, ch, pipeline);
   }
+}
 
-  if (parameters.count("pwm_ctrl2") && !(
-        parameters.count("fan_sensor2") &&
-        parameters.count("temp_sensor2") &&
-        parameters.count("min_temp2") &&
-        parameters.count("max_temp2") &&
-        parameters.count("temp_hyst2") &&
-        parameters.count("min_start2") &&
-        parameters.count("min_stop2") &&
-        parameters.count("min_speed2") &&
-        parameters.count("min_pwm2") &&
-        parameters.count("max_pwm2"))
-        ) {
-    std::cerr << "Incomplete instance definition for pwm_ctrl2!\n";
-    sd_notify(0, "STATUS=Failed to parse configuration file: Incomplete instance definition for pwm_ctrl2!\n"
-        "STOPPING=1");
-    exit(1);
+static std::unique_ptr<pwm_computer> make_pwm_computer(
+    const std::string & algorithm, const fancontroller * fc) {
+  std::unique_ptr<pwm_computer> computer;
+  if (algorithm == "linear")
+    computer.reset(new linear_pwm_computer(fc));
+  else if (algorithm == "quadratic")
+    computer.reset(new quadratic_pwm_computer(fc));
+  return computer;
+}
+
+static std::string device_path(std::unique_ptr<hwmon_index> * hwmon,
+                               const std::string & ref,
+                               const std::string & kind) {
+  if (!hwmon_index::is_reference(ref))
+    return ref;
+  if (!*hwmon)
+    hwmon->reset(new hwmon_index());
+  std::string path = (*hwmon)->resolve(ref, kind);
+  if (verbose)
+    std::cout << ref << " -> " << path << std::endl;
+  return path;
+}
+
+// Full speed on every channel before anything that could take time: with
+// a cached configuration, on the devices resolved by the previous start,
+// without parsing nor scanning hwmon. Best effort: errors are reported
+// again when channels are set up.
+static void safe_start(const config & parameters,
+                       std::unique_ptr<hwmon_index> * hwmon) {
+  config::pwm_list pwms = parameters.get_safe_pwms();
+  for (unsigned int i = 1; pwms.empty() && i <= config::max_channels; ++i) {
+    const std::string n = std::to_string(i);
+    if (!parameters.count("pwm_ctrl" + n))
+      continue;
+    try {
+      pwms.emplace_back(device_path(hwmon,
+          parameters.get<std::string>("pwm_ctrl" + n), "pwm"),
+          parameters.get<long>("max_pwm" + n));
+    } catch (const std::runtime_error & e) {
+      std::cerr << "FC" << n << ": no safe start: " << e.what() << std::endl;
+    }
   }
 
-  if (parameters.count("pwm_ctrl3") && !(
-        parameters.count("fan_sensor3") &&
-        parameters.count("temp_sensor3") &&
-        parameters.count("min_temp3") &&
-        parameters.count("max_temp3") &&
-        parameters.count("temp_hyst3") &&
-        parameters.count("min_start3") &&
-        parameters.count("min_stop3") &&
-        parameters.count("min_speed3") &&
-        parameters.count("min_pwm3") &&
-        parameters.count("max_pwm3"))
-        ) {
-    std::cerr << "Incomplete instance definition for pwm_ctrl3!\n";
-    sd_notify(0, "STATUS=Failed to parse configuration file: Incomplete instance definition for pwm_ctrl3!\n"
-        "STOPPING=1");
-    exit(1);
+  for (const auto & pwm : pwms) {
+    const std::pair<std::string, long> writes[] = {
+      {pwm.first + "_enable", 1},
+      pwm,
+    };
+    for (const auto & w : writes) {
+      const std::string val = std::to_string(w.second);
+      int fd = open(w.first.c_str(), O_WRONLY | O_CLOEXEC);
+      bool ok = fd >= 0 && pwrite(fd, val.data(), val.size(), 0) >= 0;
+      if (fd >= 0)
+        close(fd);
+      if (!ok) {
+        std::cerr << "No safe start of " << pwm.first << ": unable to write "
+                  << w.first << "!" << std::endl;
+        break;
+      }
+    }
+  }
+}
+
+[[noreturn]] static void exit_config_error(const std::runtime_error & e) {
+  std::cerr << e.what() << " (see --help-conf)" << std::endl;
+  sd_notifyf(0, "STATUS=Failed to parse configuration file: %s\n"
+      "STOPPING=1",
+      e.what());
+  exit(1);
+}
+
+static void print_help(std::ostream & out) {
+  out << "Command-line options:\n"
+         "  -h [ --help ]                 Print this help\n"
+         "  --help-conf                   Print configuration file help\n"
+         "  -v [ --verbose ]              Verbose mode\n"
+         "  -c [ --config-file ] arg      Path to configuration file\n"
+         "  --config-cache arg            Path to the validated configuration\n"
+         "                                cache (empty disables)\n";
+}
+
+static config parse_parameters(int argc, char **argv) {
+  std::string conf_file("/etc/fancontrol_cpp");
+  std::string cache_file("/var/cache/fancontrolcpp/config");
+  bool help = false, help_conf = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]), val;
+    bool has_val = false;
+    std::size_t equal = arg.find('=');
+    if (arg.compare(0, 2, "--") == 0 && equal != std::string::npos) {
+      val = arg.substr(equal + 1);
+      arg.erase(equal);
+      has_val = true;
+    }
+    std::string * target = nullptr;
+    bool known = true;
+    if (arg == "-h" || arg == "--help")
+      help = true;
+    else if (arg == "--help-conf")
+      help_conf = true;
+    else if (arg == "-v" || arg == "--verbose")
+      verbose = true;
+    else if (arg == "-c" || arg == "--config-file")
+      target = &conf_file;
+    else if (arg == "--config-cache")
+      target = &cache_file;
+    else
+      known = false;
+    std::string error;
+    if (!known || (has_val && !target))
+      error = "unrecognised option '" + std::string(argv[i]) + "'";
+    else if (target && !has_val && i + 1 == argc)
+      error = "the required argument for option '" + arg + "' is missing";
+    if (!error.empty()) {
+      std::cerr << error << "\n";
+      print_help(std::cerr);
+      sd_notifyf(0, "STATUS=Failed to parse command-line parameters: %s\n"
+          "STOPPING=1",
+          error.c_str());
+      exit(1);
+    }
+    if (target)
+      *target = has_val ? val : argv[++i];
   }
 
-  if (parameters.count("help")) {
-    std::cout << cli_desc << std::endl;
+  if (help) {
+    print_help(std::cout);
     sd_notify(0, "STATUS=Shutting down\n"
         "STOPPING=1");
     exit(0);
   }
-  if (parameters.count("help-conf")) {
-    std::cout << file_desc << std::endl;
+  if (help_conf) {
+    config::print_help(std::cout);
     sd_notify(0, "STATUS=Shutting down\n"
         "STOPPING=1");
     exit(0);
   }
-  if (parameters.count("verbose")) {
-    verbose = true;
-  }
 
-  return parameters;
+  try {
+    std::cerr << "Reading parameters from " << conf_file << std::endl;
+    config parameters = config::load(conf_file, cache_file);
+    if (verbose && parameters.is_from_cache())
+      std::cout << "Using validated configuration from " << cache_file
+                << std::endl;
+    return parameters;
+  } catch (const std::runtime_error & e) {
+    exit_config_error(e);
+  }
 }
 
 int main(int argc, char ** argv) {
   pidfile pidfile("/run/fancontrolcpp.pid");
 
-  bpo::variables_map parameters = parse_parameters(argc, argv);
-
-  unsigned int poll_interval = parameters["poll_interval"].as<unsigned int>();
-
-  long temp_hyst1 = parameters["temp_hyst1"].as<long>();
-  fancontroller * fc1 = new fancontroller(parameters["pwm_ctrl1"].as<std::string>(),
-      parameters["fan_sensor1"].as<std::string>(),
-      parameters["temp_sensor1"].as<std::string>(),
-      parameters["min_temp1"].as<long>(),
-      parameters["max_temp1"].as<long>(),
-      parameters["min_start1"].as<long>(),
-      parameters["min_stop1"].as<long>(),
-      parameters["min_speed1"].as<long>(),
-      parameters["min_pwm1"].as<long>(),
-      parameters["max_pwm1"].as<long>());
-
-  pwm_computer * pwm_computer_f1;
-  if (parameters["pwm_algorithm1"].as<std::string>() == "linear") {
-    pwm_computer_f1 = new linear_pwm_computer(fc1);
-  } else if (parameters["pwm_algorithm1"].as<std::string>() == "quadratic") {
-    pwm_computer_f1 = new quadratic_pwm_computer(fc1);
-  } else {
-    std::cerr << "Unknown PWM algorithm for pwm_ctrl1!" << std::endl;
-    sd_notify(0, "STATUS=Failed to start up: Unknown PWM algorithm for pwm_ctrl1!\n"
+  config parameters = parse_parameters(argc, argv);
+
+  // Only scanned when a device is not given by its path
+  std::unique_ptr<hwmon_index> hwmon;
+  if (parameters.get<bool>("safe_start"))
+    safe_start(parameters, &hwmon);
+  try {
+    parameters.validate();
+  } catch (const std::runtime_error & e) {
+    exit_config_error(e);
+  }
+
+  unsigned int poll_interval = parameters.get<unsigned int>("poll_interval");
+
+  const std::string io_backend = parameters.get<std::string>("io_backend");
+  if (io_backend != "pread" && io_backend != "io_uring") {
+    std::cerr << "Unknown I/O backend " << io_backend << "!" << std::endl;
+    sd_notify(0, "STATUS=Failed to start up: Unknown I/O backend!\n"
         "STOPPING=1");
     exit(1);
   }
 
-  long temp_hyst2 = 0;
-  fancontroller * fc2 = nullptr;
-  pwm_computer * pwm_computer_f2 = nullptr;
-  if (parameters.count("pwm_ctrl2")) {
-    temp_hyst2 = parameters["temp_hyst2"].as<long>();
-    fc2 = new fancontroller(parameters["pwm_ctrl2"].as<std::string>(),
-        parameters["fan_sensor2"].as<std::string>(),
-        parameters["temp_sensor2"].as<std::string>(),
-        parameters["min_temp2"].as<long>(),
-        parameters["max_temp2"].as<long>(),
-        parameters["min_start2"].as<long>(),
-        parameters["min_stop2"].as<long>(),
-        parameters["min_speed2"].as<long>(),
-        parameters["min_pwm2"].as<long>(),
-        parameters["max_pwm2"].as<long>());
-
-    if (parameters["pwm_algorithm2"].as<std::string>() == "linear") {
-      pwm_computer_f2 = new linear_pwm_computer(fc2);
-    } else if (parameters["pwm_algorithm2"].as<std::string>() == "quadratic") {
-      pwm_computer_f2 = new quadratic_pwm_computer(fc2);
-    } else {
-      std::cerr << "Unknown PWM algorithm for pwm_ctrl2!" << std::endl;
-      sd_notify(0, "STATUS=Failed to start up: Unknown PWM algorithm for pwm_ctrl2!\n"
-          "STOPPING=1");
+  std::unique_ptr<failsafe> fs;
+  unsigned int failsafe_timeout = parameters.get<unsigned int>("failsafe_timeout");
+  if (failsafe_timeout)
+    fs.reset(new failsafe(failsafe_timeout));
+
+  std::vector<std::unique_ptr<channel> > channels;
+  config::pwm_list pwms;
+  for (unsigned int i = 1; i <= config::max_channels; ++i) {
+    const std::string n = std::to_string(i);
+    if (!parameters.count("pwm_ctrl" + n))
+      continue;
+
+    std::string pwm_ctrl, fan_sensor, temp_sensor;
+    try {
+      pwm_ctrl = device_path(&hwmon, parameters.get<std::string>("pwm_ctrl" + n), "pwm");
+      fan_sensor = device_path(&hwmon, parameters.get<std::string>("fan_sensor" + n), "fan");
+      temp_sensor = device_path(&hwmon, parameters.get<std::string>("temp_sensor" + n), "temp");
+    } catch (const std::runtime_error & e) {
+      std::cerr << "Unable to find devices of pwm_ctrl" << n << ": "
+                << e.what() << std::endl;
+      sd_notifyf(0, "STATUS=Failed to start up: Unable to find devices of pwm_ctrl%s: %s\n"
+          "STOPPING=1",
+          n.c_str(), e.what());
       exit(1);
     }
-  }
 
-  long temp_hyst3 = 0;
-  fancontroller * fc3 = nullptr;
-  pwm_computer * pwm_computer_f3 = nullptr;
-  if (parameters.count("pwm_ctrl3")) {
-    temp_hyst3 = parameters["temp_hyst3"].as<long>();
-    fc3 = new fancontroller(parameters["pwm_ctrl3"].as<std::string>(),
-        parameters["fan_sensor3"].as<std::string>(),
-        parameters["temp_sensor3"].as<std::string>(),
-        parameters["min_temp3"].as<long>(),
-        parameters["max_temp3"].as<long>(),
-        parameters["min_start3"].as<long>(),
-        parameters["min_stop3"].as<long>(),
-        parameters["min_speed3"].as<long>(),
-        parameters["min_pwm3"].as<long>(),
-        parameters["max_pwm3"].as<long>());
-
-    if (parameters["pwm_algorithm3"].as<std::string>() == "linear") {
-      pwm_computer_f3 = new linear_pwm_computer(fc3);
-    } else if (parameters["pwm_algorithm3"].as<std::string>() == "quadratic") {
-      pwm_computer_f3 = new quadratic_pwm_computer(fc3);
-    } else {
-      std::cerr << "Unknown PWM algorithm for pwm_ctrl3!" << std::endl;
-      sd_notify(0, "STATUS=Failed to start up: Unknown PWM algorithm for pwm_ctrl3!\n"
-          "STOPPING=1");
+    std::unique_ptr<channel> ch(new channel);
+    ch->id = i;
+    ch->period = std::chrono::seconds(parameters.count("poll_interval" + n) ?
+        parameters.get<unsigned int>("poll_interval" + n) : poll_interval);
+    ch->fc.reset(new fancontroller(pwm_ctrl, fan_sensor, temp_sensor,
+        parameters.get<long>("min_temp" + n),
+        parameters.get<long>("max_temp" + n),
+        parameters.get<long>("min_start" + n),
+        parameters.get<long>("min_stop" + n),
+        parameters.get<long>("min_speed" + n),
+        parameters.get<long>("min_pwm" + n),
+        parameters.get<long>("max_pwm" + n)));
+    if (io_backend == "io_uring") {
+      try {
+        ch->fc->use_io_uring();
+      } catch (const std::runtime_error & e) {
+        std::cerr << "Warning: FC" << n << " falls back to pread, io_uring "
+                  << "is not available: " << e.what() << std::endl;
+        sd_notifyf(0, "STATUS=FC%s falls back to pread, io_uring is not "
+            "available: %s",
+            n.c_str(), e.what());
+      }
+    }
+
+    ch->computer = make_pwm_computer(
+        parameters.get<std::string>("pwm_algorithm" + n), ch->fc.get());
+    if (!ch->computer) {
+      std::cerr << "Unknown PWM algorithm for pwm_ctrl" << n << "!" << std::endl;
+      sd_notifyf(0, "STATUS=Failed to start up: Unknown PWM algorithm for pwm_ctrl%s!\n"
+          "STOPPING=1",
+          n.c_str());
       exit(1);
     }
+
+    const std::string feed_forward = parameters.get<std::string>("feed_forward" + n);
+    const double ff_alpha = parameters.get<double>("ff_alpha" + n);
+    if (feed_forward != "none") {
+      try {
+        if (!(ff_alpha > 0.0 && ff_alpha <= 1.0))
+          throw std::runtime_error("ff_alpha must be in ]0, 1]!");
+        ch->load.reset(new load_monitor(feed_forward,
+            parameters.get<double>("ff_full_power" + n)));
+      } catch (const std::runtime_error & e) {
+        std::cerr << "Invalid feed-forward for pwm_ctrl" << n << ": "
+                  << e.what() << std::endl;
+        sd_notifyf(0, "STATUS=Failed to start up: Invalid feed-forward for pwm_ctrl%s: %s\n"
+            "STOPPING=1",
+            n.c_str(), e.what());
+        exit(1);
+      }
+    }
+
+    const std::string estimator = parameters.get<std::string>("estimator" + n);
+    if ((estimator != "none" && estimator != "kalman") ||
+        parameters.get<double>("kalman_noise" + n) <= 0.0 ||
+        parameters.get<double>("kalman_accel" + n) <= 0.0 ||
+        parameters.get<unsigned int>("predict_cycles" + n) > 2) {
+      std::cerr << "Invalid estimator definition for pwm_ctrl" << n << "!" << std::endl;
+      sd_notifyf(0, "STATUS=Failed to start up: Invalid estimator definition for pwm_ctrl%s!\n"
+          "STOPPING=1",
+          n.c_str());
+      exit(1);
+    }
+
+    if (parameters.get<bool>("stall_detect" + n)) {
+      ch->health.reset(new fan_health(fan_sensor,
+          ch->fc->get_min_stop(), ch->fc->get_min_speed(),
+          parameters.get<double>("stall_ratio" + n)));
+    }
+
+    const std::string recalibrate = parameters.get<std::string>("recalibrate" + n);
+    if (recalibrate != "none" && recalibrate != "detect" &&
+        recalibrate != "reprobe") {
+      std::cerr << "Invalid recalibrate value for pwm_ctrl" << n << "!" << std::endl;
+      sd_notifyf(0, "STATUS=Failed to start up: Invalid recalibrate value for pwm_ctrl%s!\n"
+          "STOPPING=1",
+          n.c_str());
+      exit(1);
+    }
+    if (recalibrate != "none")
+      ch->drift.reset(new drift_monitor(
+          parameters.get<double>("drift_threshold" + n),
+          ch->fc->get_min_stop(), ch->fc->get_min_speed()));
+    ch->reprobe = recalibrate == "reprobe";
+
+    const std::string filters = parameters.get<std::string>("filters" + n);
+    const double ema_alpha = parameters.get<double>("ema_alpha" + n);
+    if ((filters != "legacy" && filters != "damped") ||
+        !(ema_alpha > 0.0 && ema_alpha <= 1.0)) {
+      std::cerr << "Invalid filters definition for pwm_ctrl" << n << "!" << std::endl;
+      sd_notifyf(0, "STATUS=Failed to start up: Invalid filters definition for pwm_ctrl%s!\n"
+          "STOPPING=1",
+          n.c_str());
+      exit(1);
+    }
+
+    ch->page = nullptr;
+    ch->page_index = 0;
+    ch->fs = fs.get();
+    ch->failsafe_index = 0;
+    if (fs)
+      ch->failsafe_index = fs->add(pwm_ctrl, ch->fc->get_max_pwm());
+    pwms.emplace_back(pwm_ctrl, ch->fc->get_max_pwm());
+    channels.push_back(std::move(ch));
+  }
+  parameters.save_cache(pwms);
+
+  for (auto & ch : channels) {
+    const std::string group = "group" + std::to_string(ch->id);
+    if (!parameters.count(group))
+      continue;
+    for (auto & other : channels) {
+      const std::string other_group = "group" + std::to_string(other->id);
+      if (other != ch && parameters.count(other_group) &&
+          parameters.get<std::string>(other_group) ==
+            parameters.get<std::string>(group))
+        ch->siblings.push_back(other.get());
+    }
+  }
+
+  // Monitoring only, control goes on without it
+  std::unique_ptr<status_page> page;
+  const std::string page_path = parameters.get<std::string>("status_page");
+  if (!page_path.empty()) {
+    try {
+      page.reset(new status_page(page_path, channels.size()));
+      for (std::size_t i = 0; i < channels.size(); ++i) {
+        channels[i]->page = page.get();
+        channels[i]->page_index = i;
+      }
+    } catch (const std::runtime_error & e) {
+      std::cerr << "Warning: no status page: " << e.what() << std::endl;
+    }
   }
 
 #if defined(MY_DEBUG)
-  for (long temp = parameters["min_temp1"].as<long>() - 5000L;
-       temp <= parameters["max_temp1"].as<long>() + 5000L;
+  for (long temp = parameters.get<long>("min_temp1") - 5000L;
+       temp <= parameters.get<long>("max_temp1") + 5000L;
        temp += 1000L) {
     std::cout << temp << "\t"
-              << pwm_computer_f1->pwm_for(temp)
+              << channels.front()->computer->pwm_for(temp)
               << std::endl;
   }
 #endif
 
+  uint64_t watchdog_usec = 0;
+  bool watchdog = sd_watchdog_enabled(0, &watchdog_usec) > 0;
+  for (auto & ch : channels) {
+    if (watchdog && std::chrono::microseconds(watchdog_usec) <= ch->period) {
+      std::cerr << "Warning: watchdog interval (" << watchdog_usec / 1000
+                << "ms) is shorter than poll interval of FC" << ch->id
+                << "!" << std::endl;
+    }
+  }
+
   std::signal(SIGINT, signal_handler);
   std::signal(SIGTERM, signal_handler);
   std::signal(SIGHUP, signal_handler);
 
+  // Keep signals for the main thread, so that they interrupt its sleep
+  sigset_t signals, old_signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+  if (fs)
+    fs->start();
+  for (auto & ch : channels)
+    start_worker(ch.get(), parameters);
+  pthread_sigmask(SIG_SETMASK, &old_signals, nullptr);
+
   sd_notifyf(0, "READY=1\n"
       "STATUS=Entering control loop...\n"
       "MAINPID=%lu",
       (unsigned long) pidfile.get_pid());
 
-  try {
-    do {
-      if (verbose) {
-        std::cout << "FC1 "
-                  << "Temperature: " << fc1->read_temperature()
-                  << "  Fan speed: " << fc1->read_fan_speed()
-                  << "  PWM value: " << fc1->read_fan_pwm()
+  // Supervisor: report workers status, and only feed the watchdog while
+  // every channel keeps completing its cycles on time
+  const loop_clock::duration tick = std::chrono::seconds(1);
+  loop_clock::time_point next_tick = loop_clock::now();
+  unsigned long reported_overruns = 0, reported_faults = 0,
+                reported_stalls = 0, reported_trips = 0,
+                reported_recalibrations = 0;
+  std::vector<unsigned long> reported_cycles(channels.size(), 0);
+  do {
+    next_tick += tick;
+    loop_clock::time_point now = loop_clock::now();
+
+    bool on_time = true;
+    unsigned long overruns = 0, faults = 0, faulted = 0, stalls = 0,
+                  stalled = 0, recalibrations = 0;
+    for (std::size_t i = 0; i < channels.size(); ++i) {
+      const channel & ch = *channels[i];
+      if (now - ch.status.get_last_on_time() > ch.period + tick)
+        on_time = false;
+      overruns += ch.status.overruns;
+      faults += ch.status.faults;
+      if (ch.status.faulted)
+        ++faulted;
+      stalls += ch.status.stalls;
+      if (ch.status.stalled)
+        ++stalled;
+      recalibrations += ch.status.recalibrations;
+
+      unsigned long cycles = ch.status.cycles;
+      if (verbose && cycles != reported_cycles[i]) {
+        reported_cycles[i] = cycles;
+        std::cout << "FC" << ch.id << " "
+                  << "Temperature: " << ch.status.temperature
+                  << "  Fan speed: " << ch.status.fan_speed
+                  << "  PWM value: " << ch.status.pwm
                   << std::endl;
       }
-      update(fc1, pwm_computer_f1, temp_hyst1);
-      if (parameters.count("pwm_ctrl2")) {
-        if (verbose) {
-          std::cout << "FC2 "
-                    << "Temperature: " << fc2->read_temperature()
-                    << "  Fan speed: " << fc2->read_fan_speed()
-                    << "  PWM value: " << fc2->read_fan_pwm()
-                    << std::endl;
-        }
-        update(fc2, pwm_computer_f2, temp_hyst2);
-      }
-      if (parameters.count("pwm_ctrl3")) {
-        if (verbose) {
-          std::cout << "FC3 "
-                    << "Temperature: " << fc3->read_temperature()
-                    << "  Fan speed: " << fc3->read_fan_speed()
-                    << "  PWM value: " << fc3->read_fan_pwm()
-                    << std::endl;
-        }
-        update(fc3, pwm_computer_f3, temp_hyst3);
-      }
-    } while (!sleep(poll_interval) && !shutdown_request);
-  } catch (const std::runtime_error & e) {
-    std::cerr << "Got error with update()!" << std::endl;
-    std::cerr << e.what();
-    sd_notify(0, "STATUS=Got error with update()!\n"
-        "STOPPING=1");
-    std::cerr << "Restoring fan max speed" << std::endl;
-    fc1->set_full_speed();
-    delete pwm_computer_f1;
-    delete fc1;
-    if (parameters.count("pwm_ctrl2")) {
-      fc2->set_full_speed();
-      delete pwm_computer_f2;
-      delete fc2;
     }
-    if (parameters.count("pwm_ctrl3")) {
-      fc3->set_full_speed();
-      delete pwm_computer_f3;
-      delete fc3;
+    if (watchdog && on_time)
+      sd_notify(0, "WATCHDOG=1");
+
+    unsigned long trips = fs ? fs->get_trips() : 0;
+    if (overruns != reported_overruns || faults != reported_faults ||
+        stalls != reported_stalls || trips != reported_trips ||
+        recalibrations != reported_recalibrations) {
+      reported_overruns = overruns;
+      reported_faults = faults;
+      reported_stalls = stalls;
+      reported_trips = trips;
+      reported_recalibrations = recalibrations;
+      sd_notifyf(0, "STATUS=Control loop: %lu overruns, %lu faults "
+          "(%lu channels faulted), %lu stalls (%lu fans stalled), "
+          "%lu failsafe trips, %lu recalibrations",
+          overruns, faults, faulted, stalls, stalled, trips, recalibrations);
     }
-    return 1;
+  } while (sleep_until(next_tick) && !shutdown_request);
+
+  {
+    std::lock_guard<std::mutex> lock(workers_mutex);
+    workers_stop = true;
   }
+  workers_cv.notify_all();
+  for (auto & ch : channels)
+    ch->worker.join();
 
   std::cerr << "Leaving." << std::endl;
-  delete pwm_computer_f1;
-  delete fc1;
-  if (parameters.count("pwm_ctrl2")) {
-      delete pwm_computer_f2;
-      delete fc2;
-  }
-  if (parameters.count("pwm_ctrl3")) {
-      delete pwm_computer_f3;
-      delete fc3;
-  }
+  channels.clear();
   sd_notify(0, "STATUS=Shutting down\n"
       "STOPPING=1");
   return 0;
@@ -1,19 +1,32 @@
 #include "lib/fancontroller.h"
 
+#include <fcntl.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cerrno>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
-#include <fstream>
 #include <sstream>
 #include <stdexcept>
 
+#include "lib/io_uring_batch.h"
+#include "lib/probes.h"
+
 /*
  * TODO:
  * Resolve filenames with realpath() or boost::filesystem
  * Finish reading Documentation/sysfs-rules.txt
  */
 
+static int open_device(const std::string &path, int flags, const char * what) {
+  int fd = open(path.c_str(), flags | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error(std::string("Could not open ") + what + "!");
+  return fd;
+}
 
 fancontroller::fancontroller(const std::string &controller,
                              const std::string &fan_sensor,
@@ -26,14 +39,27 @@ fancontroller::fancontroller(const std::string &controller,
     min_start(min_start), min_stop(min_stop), min_speed(min_speed),
     min_pwm(min_pwm), max_pwm(max_pwm),
     controller_enabler(controller + "_enable"),
-    up_step(0) {
-  if (std::ofstream(controller.c_str()).fail())
-    throw std::runtime_error("Could not open PWM device!");
-  if (std::ifstream(fan_sensor.c_str()).fail())
-    throw std::runtime_error("Could not open fan sensor device!");
-  if (std::ifstream(temp_sensor.c_str()).fail())
-    throw std::runtime_error("Could not open temperature sensor device!");
-  write_value(controller_enabler, 1);
+    controller_fd(-1), fan_sensor_fd(-1), temp_sensor_fd(-1) {
+  try {
+    controller_fd = open_device(controller, O_RDWR, "PWM device");
+    fan_sensor_fd = open_device(fan_sensor, O_RDONLY, "fan sensor device");
+    temp_sensor_fd = open_device(temp_sensor, O_RDONLY,
+                                 "temperature sensor device");
+    int enabler_fd = open_device(controller_enabler, O_WRONLY,
+                                 "PWM enable device");
+    try {
+      write_value(enabler_fd, controller_enabler, 1);
+    } catch (...) {
+      close(enabler_fd);
+      throw;
+    }
+    close(enabler_fd);
+  } catch (...) {
+    for (int fd : {controller_fd, fan_sensor_fd, temp_sensor_fd})
+      if (fd >= 0)
+        close(fd);
+    throw;
+  }
 }
 
 fancontroller::~fancontroller() {
@@ -41,69 +67,144 @@ fancontroller::~fancontroller() {
     set_full_speed();
   }
   catch (...) {}
+  close(controller_fd);
+  close(fan_sensor_fd);
+  close(temp_sensor_fd);
+}
+
+void fancontroller::use_io_uring() {
+  try {
+    uring.reset(new io_uring_batch(3));
+    // Kernels before 5.6 have io_uring without read/write operations
+    long temperature, pwm, fan_speed;
+    read_state(&temperature, &pwm, &fan_speed);
+  } catch (const std::runtime_error &) {
+    uring.reset();
+    throw;
+  }
+}
+
+long fancontroller::parse_value(const char * buf, long len,
+                                const std::string &path) {
+  if (len < 0)
+    throw std::runtime_error("Unable to read " + path + ": " +
+                             std::strerror(static_cast<int>(-len)) + "!");
+  char * end;
+  long val = std::strtol(buf, &end, 10);
+  if (end == buf)
+    throw std::runtime_error("Unable to read " + path + "!");
+  return val;
 }
 
-long fancontroller::read_value(const std::string &path) const {
+long fancontroller::read_value(int fd, const std::string &path) const {
 #if defined(MY_DEBUG)
   std::cerr << "Reading " << path << std::endl;
 #endif
-  std::ifstream file(path.c_str());
-  long val;
-  file >> val;
-  if (file.fail())
-    throw std::runtime_error("Unable to read " + path + "!");
+  FC_PROBE2(read_begin, fd, path.c_str());
+  char buf[32];
+  ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (len >= 0)
+    buf[len] = '\0';
+  long val = parse_value(buf, len < 0 ? -errno : len, path);
+  FC_PROBE3(read_done, fd, path.c_str(), val);
   return val;
 }
 
-void fancontroller::write_value(const std::string &path, long val) {
+void fancontroller::write_value(int fd, const std::string &path, long val) {
 #if defined(MY_DEBUG)
   std::cerr << "Writing " << val << " to " << path << std::endl;
 #endif
-  std::ofstream file(path.c_str());
-  file << val;
-  if (file.fail()) {
+  FC_PROBE3(write_begin, fd, path.c_str(), val);
+  std::string str = std::to_string(val);
+  if (pwrite(fd, str.data(), str.size(), 0) < 0) {
     std::stringstream exc;
     exc << "Unable to write " << val << " to " << path << "!";
     throw std::runtime_error(exc.str());
   }
+  FC_PROBE3(write_done, fd, path.c_str(), val);
 }
 
 long fancontroller::read_temperature() const {
-  return read_value(temp_sensor);
+  return read_value(temp_sensor_fd, temp_sensor);
 }
 
 long fancontroller::read_fan_speed() const {
-  return read_value(fan_sensor);
+  return read_value(fan_sensor_fd, fan_sensor);
 }
 
 long fancontroller::read_fan_pwm() const {
-  return read_value(controller);
+  return read_value(controller_fd, controller);
+}
+
+void fancontroller::read_state(long * temperature, long * pwm,
+                               long * fan_speed) const {
+  if (!uring) {
+    *temperature = read_temperature();
+    *pwm = read_fan_pwm();
+    if (fan_speed)
+      *fan_speed = read_fan_speed();
+    return;
+  }
+
+#if defined(MY_DEBUG)
+  std::cerr << "Reading " << temp_sensor << ", " << controller
+            << (fan_speed ? ", " + fan_sensor : "") << " in one batch"
+            << std::endl;
+#endif
+  char buf[3][32];
+  int res[3] = {-EIO, -EIO, -EIO};
+  const int count = fan_speed ? 3 : 2;
+  FC_PROBE1(batch_begin, count);
+  uring->prep_read(temp_sensor_fd, buf[0], sizeof(buf[0]) - 1);
+  uring->prep_read(controller_fd, buf[1], sizeof(buf[1]) - 1);
+  if (fan_speed)
+    uring->prep_read(fan_sensor_fd, buf[2], sizeof(buf[2]) - 1);
+  uring->submit_and_wait(res);
+  FC_PROBE1(batch_done, count);
+  for (int i = 0; i < count; ++i)
+    if (res[i] >= 0)
+      buf[i][res[i]] = '\0';
+  *temperature = parse_value(buf[0], res[0], temp_sensor);
+  *pwm = parse_value(buf[1], res[1], controller);
+  if (fan_speed)
+    *fan_speed = parse_value(buf[2], res[2], fan_sensor);
 }
 
 void fancontroller::set_fan_pwm(long pwm) {
-  write_value(controller, pwm);
+  write_value(controller_fd, controller, pwm);
 }
 
 void fancontroller::set_full_speed() {
-  write_value(controller, max_pwm);
+  write_value(controller_fd, controller, max_pwm);
 }
 
-void fancontroller::start_fan() {
+void fancontroller::start_fan(const std::function<bool()> &wait) {
+  const long step = std::max(1L, (max_pwm - min_start + start_steps - 1) /
+                                 start_steps);
   long pwm = min_start;
+  FC_PROBE2(start_fan_begin, controller.c_str(), pwm);
   set_fan_pwm(pwm);
-  sleep(1);
-  while (read_fan_speed() < min_speed) {
+  if (!wait())
+    throw std::runtime_error("Interrupted while starting fan!");
+  long fan_speed;
+  while ((fan_speed = read_fan_speed()) < min_speed) {
+    FC_PROBE3(start_fan_step, controller.c_str(), pwm, fan_speed);
     if (pwm < max_pwm) {
-      set_fan_pwm(++pwm);
-      sleep(1);
+      pwm = std::min(pwm + step, max_pwm);
+      set_fan_pwm(pwm);
+      if (!wait())
+        throw std::runtime_error("Interrupted while starting fan!");
     } else {
       throw std::runtime_error("Unable to start fan!");
     }
   }
+  FC_PROBE2(start_fan_done, controller.c_str(), pwm);
 }
 
 void fancontroller::stop_fan() {
+  FC_PROBE1(stop_fan_begin, controller.c_str());
   set_fan_pwm(0);
   while (read_fan_speed())
     sleep(1);
+  FC_PROBE1(stop_fan_done, controller.c_str());
 }
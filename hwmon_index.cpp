@@ -0,0 +1,177 @@
+#include "lib/hwmon_index.h"
+
+#include <dirent.h>
+#include <cstdlib>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+static const std::string LABEL_SUFFIX("_label");
+static const std::string INPUT_SUFFIX("_input");
+
+static std::string real_path(const std::string &path) {
+  std::unique_ptr<char, void (*)(void *)> real(
+      realpath(path.c_str(), nullptr), std::free);
+  return real ? std::string(real.get()) : std::string();
+}
+
+static std::string read_line(const std::string &path) {
+  std::string line;
+  std::ifstream in(path);
+  std::getline(in, line);
+  return line;
+}
+
+// Channel attributes look like type<N>[_item], e.g. pwm1, fan2_input
+static bool is_attribute(const std::string &name) {
+  std::size_t i = 0;
+  while (i < name.size() && std::islower(static_cast<unsigned char>(name[i])))
+    ++i;
+  std::size_t digits = i;
+  while (i < name.size() && std::isdigit(static_cast<unsigned char>(name[i])))
+    ++i;
+  return digits > 0 && i > digits && (i == name.size() || name[i] == '_');
+}
+
+static std::string channel_type(const std::string &channel) {
+  std::size_t i = 0;
+  while (i < channel.size() &&
+         std::islower(static_cast<unsigned char>(channel[i])))
+    ++i;
+  return channel.substr(0, i);
+}
+
+hwmon_index::hwmon_index(const std::string &root) {
+  DIR * dir = opendir(root.c_str());
+  if (!dir)
+    throw std::runtime_error("Could not list hwmon chips in " + root + "!");
+  while (const dirent * entry = readdir(dir)) {
+    if (entry->d_name[0] == '.')
+      continue;
+    chip c;
+    c.id = entry->d_name;
+    c.path = real_path(root + "/" + c.id);
+    if (c.path.empty())
+      continue;
+    scan_chip(&c, c.path);
+    // Older drivers keep their attributes in the parent device directory
+    std::string device = real_path(c.path + "/device");
+    if (!device.empty())
+      scan_chip(&c, device);
+    c.name = read_line(c.path + "/name");
+    if (c.name.empty() && !device.empty())
+      c.name = read_line(device + "/name");
+    chips.push_back(std::move(c));
+  }
+  closedir(dir);
+
+  // hwmon2 before hwmon10
+  std::sort(chips.begin(), chips.end(), [](const chip & a, const chip & b) {
+    return a.id.size() != b.id.size() ? a.id.size() < b.id.size()
+                                      : a.id < b.id;
+  });
+}
+
+void hwmon_index::scan_chip(chip * c, const std::string &dir) const {
+  DIR * d = opendir(dir.c_str());
+  if (!d)
+    return;
+  while (const dirent * entry = readdir(d)) {
+    const std::string name(entry->d_name);
+    if (!is_attribute(name) || c->attributes.count(name))
+      continue;
+    const std::string path = dir + "/" + name;
+    c->attributes[name] = path;
+    std::size_t pos = name.size() - std::min(name.size(), LABEL_SUFFIX.size());
+    if (name.compare(pos, std::string::npos, LABEL_SUFFIX) == 0) {
+      const std::string text = read_line(path);
+      if (!text.empty())
+        c->labels.emplace(text, name.substr(0, pos));
+    }
+  }
+  closedir(d);
+}
+
+const hwmon_index::chip * hwmon_index::find_chip(const std::string &name) const {
+  const chip * found = nullptr;
+  for (const chip & c : chips) {
+    if (c.id == name)
+      return &c;
+    if (c.name != name)
+      continue;
+    if (found)
+      throw std::runtime_error("Several hwmon chips are named " + name +
+                               ", use hwmonN instead!");
+    found = &c;
+  }
+  return found;
+}
+
+std::string hwmon_index::attribute(const chip & c, const std::string &channel,
+                                   const std::string &kind) const {
+  const std::string type = channel_type(channel);
+  std::string name;
+  if (type == kind)
+    name = kind == "pwm" ? channel : channel + INPUT_SUFFIX;
+  else if (kind == "pwm" && type == "fan")
+    name = kind + channel.substr(type.size());
+  auto it = c.attributes.find(name);
+  return it == c.attributes.end() ? std::string() : it->second;
+}
+
+std::string hwmon_index::resolve(const std::string &ref,
+                                 const std::string &kind) const {
+  if (!is_reference(ref))
+    return ref;
+  std::size_t colon = ref.find(':');
+  if (colon == std::string::npos)
+    throw std::runtime_error("Invalid hwmon reference " + ref + "!");
+  const std::string prefix = ref.substr(0, colon);
+  const std::string rest = ref.substr(colon + 1);
+
+  if (prefix == "label") {
+    // Labels of the wanted type first, then fanN ones for pwmN
+    for (bool exact : {true, false}) {
+      std::string found;
+      for (const chip & c : chips) {
+        auto range = c.labels.equal_range(rest);
+        for (auto it = range.first; it != range.second; ++it) {
+          if ((channel_type(it->second) == kind) != exact)
+            continue;
+          std::string path = attribute(c, it->second, kind);
+          if (path.empty())
+            continue;
+          if (!found.empty())
+            throw std::runtime_error("Ambiguous hwmon reference " + ref + "!");
+          found = path;
+        }
+      }
+      if (!found.empty())
+        return found;
+    }
+    throw std::runtime_error("No " + kind + " attribute labelled " + rest +
+                             "!");
+  }
+
+  const chip * c = find_chip(prefix);
+  if (!c)
+    throw std::runtime_error("No hwmon chip named " + prefix + "!");
+  // A channel of the wanted type, e.g. fan1, or its input, fan1_input
+  std::string channel = rest;
+  std::size_t pos = rest.size() - std::min(rest.size(), INPUT_SUFFIX.size());
+  if (kind != "pwm" &&
+      rest.compare(pos, std::string::npos, INPUT_SUFFIX) == 0)
+    channel.erase(pos);
+  if (!is_attribute(channel) || channel.find('_') != std::string::npos ||
+      channel_type(channel) != kind)
+    throw std::runtime_error("Attribute " + rest + " of hwmon chip " +
+                             prefix + " is not a " + kind + " channel!");
+  std::string path = attribute(*c, channel, kind);
+  if (path.empty())
+    throw std::runtime_error("No attribute " + rest + " on hwmon chip " +
+                             prefix + "!");
+  return path;
+}
@@ -0,0 +1,163 @@
+#include "lib/io_uring_batch.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING
+#endif
+#endif
+
+#if defined(HAVE_IO_URING)
+
+static int io_uring_setup(unsigned int entries, io_uring_params * p) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit,
+                          unsigned int min_complete, unsigned int flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+static std::runtime_error uring_error(const std::string & what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+io_uring_batch::io_uring_batch(unsigned int entries)
+  : ring_fd(-1), entries(entries), queued(0),
+    sq_ptr(MAP_FAILED), sq_size(0), cq_ptr(MAP_FAILED), cq_size(0),
+    sqes(nullptr), sqes_size(0) {
+  io_uring_params p;
+  std::memset(&p, 0, sizeof(p));
+  ring_fd = io_uring_setup(entries, &p);
+  if (ring_fd < 0)
+    throw uring_error("Unable to set up io_uring");
+
+  sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap && cq_size > sq_size)
+    sq_size = cq_size;
+
+  sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq_ptr == MAP_FAILED) {
+    close(ring_fd);
+    throw uring_error("Unable to map io_uring submission queue");
+  }
+  if (single_mmap) {
+    cq_ptr = sq_ptr;
+  } else {
+    cq_ptr = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED) {
+      munmap(sq_ptr, sq_size);
+      close(ring_fd);
+      throw uring_error("Unable to map io_uring completion queue");
+    }
+  }
+
+  sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+  void * sqes_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (sqes_ptr == MAP_FAILED) {
+    if (cq_ptr != sq_ptr)
+      munmap(cq_ptr, cq_size);
+    munmap(sq_ptr, sq_size);
+    close(ring_fd);
+    throw uring_error("Unable to map io_uring submission entries");
+  }
+  sqes = static_cast<io_uring_sqe *>(sqes_ptr);
+
+  char * sq = static_cast<char *>(sq_ptr);
+  sq_tail  = reinterpret_cast<unsigned int *>(sq + p.sq_off.tail);
+  sq_mask  = reinterpret_cast<unsigned int *>(sq + p.sq_off.ring_mask);
+  sq_array = reinterpret_cast<unsigned int *>(sq + p.sq_off.array);
+  char * cq = static_cast<char *>(cq_ptr);
+  cq_head = reinterpret_cast<unsigned int *>(cq + p.cq_off.head);
+  cq_tail = reinterpret_cast<unsigned int *>(cq + p.cq_off.tail);
+  cq_mask = reinterpret_cast<unsigned int *>(cq + p.cq_off.ring_mask);
+  cqes    = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+}
+
+io_uring_batch::~io_uring_batch() {
+  munmap(sqes, sqes_size);
+  if (cq_ptr != sq_ptr)
+    munmap(cq_ptr, cq_size);
+  munmap(sq_ptr, sq_size);
+  close(ring_fd);
+}
+
+void io_uring_batch::prep(uint8_t opcode, int fd, uint64_t addr,
+                          unsigned int len) {
+  if (queued == entries)
+    throw std::logic_error("io_uring batch is full!");
+  unsigned int tail = *sq_tail + queued;
+  unsigned int index = tail & *sq_mask;
+  io_uring_sqe * sqe = &sqes[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->off = 0;
+  sqe->addr = addr;
+  sqe->len = len;
+  sqe->user_data = queued;
+  sq_array[index] = index;
+  ++queued;
+}
+
+void io_uring_batch::prep_read(int fd, char * buf, unsigned int len) {
+  prep(IORING_OP_READ, fd, reinterpret_cast<uint64_t>(buf), len);
+}
+
+void io_uring_batch::submit_and_wait(int * results) {
+  const unsigned int total = queued;
+  unsigned int to_submit = queued;
+  queued = 0;
+  __atomic_store_n(sq_tail, *sq_tail + to_submit, __ATOMIC_RELEASE);
+
+  // The wait may end before all completions, e.g. on a signal: go on until
+  // every request of this batch is reaped
+  unsigned int completed = 0;
+  unsigned int head = *cq_head;
+  while (completed < total) {
+    int ret = io_uring_enter(ring_fd, to_submit, total - completed,
+                             IORING_ENTER_GETEVENTS);
+    if (ret < 0 && errno != EINTR)
+      throw uring_error("Unable to submit io_uring batch");
+    if (ret > 0)
+      to_submit -= ret < static_cast<int>(to_submit) ? ret : to_submit;
+
+    unsigned int tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      const io_uring_cqe & cqe = cqes[head & *cq_mask];
+      if (cqe.user_data < total)
+        results[cqe.user_data] = cqe.res;
+      ++head;
+      ++completed;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+}
+
+#else  // HAVE_IO_URING
+
+io_uring_batch::io_uring_batch(unsigned int) {
+  throw std::runtime_error("io_uring support not compiled in");
+}
+
+io_uring_batch::~io_uring_batch() {}
+
+void io_uring_batch::prep(uint8_t, int, uint64_t, unsigned int) {}
+void io_uring_batch::prep_read(int, char *, unsigned int) {}
+void io_uring_batch::submit_and_wait(int *) {}
+
+#endif  // HAVE_IO_URING
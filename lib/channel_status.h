@@ -0,0 +1,42 @@
+#ifndef LIB_CHANNEL_STATUS_H_
+#define LIB_CHANNEL_STATUS_H_
+#include <atomic>
+#include <chrono>
+
+/*
+ * Per-channel entry of the status table.
+ *
+ * Written only by the channel's worker thread (but boost_requests, by
+ * workers of its thermal group), read by the supervisor without locking.
+ * Fields are independent atomics: readers may observe a mix of two
+ * consecutive cycles, which is fine for reporting purposes.
+ */
+struct channel_status {
+  typedef std::chrono::steady_clock clock;
+
+  std::atomic<long> temperature{0};
+  std::atomic<long> fan_speed{0};
+  std::atomic<long> pwm{0};
+
+  std::atomic<unsigned long> cycles{0};
+  std::atomic<unsigned long> overruns{0};
+  std::atomic<unsigned long> faults{0};
+  std::atomic<bool> faulted{false};
+  std::atomic<unsigned long> stalls{0};
+  std::atomic<bool> stalled{false};
+  std::atomic<bool> drifted{false};
+  std::atomic<unsigned long> recalibrations{0};
+  // Stalled siblings in the channel thermal group, written by their workers
+  std::atomic<unsigned int> boost_requests{0};
+
+  // End of the last cycle completed within its deadline
+  std::atomic<clock::rep> last_on_time{0};
+
+  void mark_on_time(clock::time_point t) {
+    last_on_time = t.time_since_epoch().count();
+  }
+  clock::time_point get_last_on_time() const {
+    return clock::time_point(clock::duration(last_on_time.load()));
+  }
+};
+#endif  // LIB_CHANNEL_STATUS_H_
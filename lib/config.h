@@ -0,0 +1,72 @@
+#ifndef LIB_CONFIG_H_
+#define LIB_CONFIG_H_
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Configuration file loader.
+ *
+ * Options are described once, in the table of config.cpp; channel ones,
+ * e.g. pwm_ctrlN, exist for N from 1 to max_channels. The file is made of
+ * name=value lines and # comments. Validated values can be saved to a
+ * binary cache, reused instead of the file as long as this one keeps the
+ * same inode, size and modification time, along with resolved PWM devices
+ * so that safe start needs neither parsing nor a hwmon scan.
+ *
+ * Errors throw std::runtime_error.
+ */
+class config {
+ public:
+  static const unsigned int max_channels = 3;
+  // Resolved PWM device and max_pwm of each channel
+  typedef std::vector<std::pair<std::string, long> > pwm_list;
+
+  // From the cache when it matches path, otherwise parsed from path with
+  // defaults applied but not validated yet; cache_path may be empty
+  static config load(const std::string &path, const std::string &cache_path);
+  static void print_help(std::ostream &out);
+
+  // Checks that required options are there; a cached config already was
+  void validate() const;
+  // Saves values and PWM devices for next start, failing silently
+  void save_cache(const pwm_list &pwms) const;
+  // Empty unless read from the cache
+  const pwm_list & get_safe_pwms() const { return safe_pwms; }
+
+  // Whether the option was set, or has a default value
+  bool count(const std::string &name) const;
+  template<typename T>
+  T get(const std::string &name) const;
+
+  bool is_from_cache() const { return from_cache; }
+
+ private:
+  struct value {
+    bool set;
+    long integer;   // long, unsigned int and bool options
+    double real;
+    std::string text;
+  };
+
+  config();
+  void parse(const std::string &path);
+  void set(const std::string &name, const std::string &text, unsigned int line);
+  void set_defaults();
+  bool read_cache();
+  const value & find(const std::string &name, int type) const;
+
+  std::vector<value> values;  // Per option, then per channel option and N
+  pwm_list safe_pwms;
+  std::string cache_path;
+  std::string cache_key;      // Empty when not cached
+  bool from_cache;
+};
+
+template<> std::string config::get<std::string>(const std::string &name) const;
+template<> long config::get<long>(const std::string &name) const;
+template<> unsigned int config::get<unsigned int>(const std::string &name) const;
+template<> double config::get<double>(const std::string &name) const;
+template<> bool config::get<bool>(const std::string &name) const;
+#endif  // LIB_CONFIG_H_
@@ -0,0 +1,61 @@
+#ifndef LIB_FAILSAFE_H_
+#define LIB_FAILSAFE_H_
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Independent last-resort path driving fans to full speed.
+ *
+ * PWM devices are opened once at registration time and only written with
+ * plain pwrite() from a dedicated thread, so a control loop stuck in a
+ * sysfs read or in fancontroller::stop_fan() cannot prevent it from firing.
+ * Each channel must be kicked at least once every timeout seconds, or it
+ * is put to full speed every second until kicked again.
+ */
+class failsafe {
+ public:
+  explicit failsafe(unsigned int timeout);
+  ~failsafe();
+
+  failsafe(const failsafe &) = delete;
+  failsafe & operator=(const failsafe &) = delete;
+
+  // Returns channel index to give to kick()
+  std::size_t add(const std::string &controller, long max_pwm);
+  void start();
+  void kick(std::size_t index);
+
+  unsigned int get_timeout() const { return timeout; }
+  unsigned long get_trips() const { return trips.load(); }
+
+ private:
+  typedef std::chrono::steady_clock clock;
+
+  struct channel {
+    std::string controller;
+    int fd;
+    std::string max_pwm;
+    std::atomic<clock::rep> last_kick;
+    bool tripped;
+  };
+
+  void run();
+  // Writes max_pwm; first of a trip, also reports it
+  void trip(channel * ch, bool first);
+
+  const unsigned int timeout;
+  std::vector<std::unique_ptr<channel> > channels;
+  std::atomic<unsigned long> trips;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stop_request;
+  std::thread thread;
+};
+#endif  // LIB_FAILSAFE_H_
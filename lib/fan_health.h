@@ -0,0 +1,58 @@
+#ifndef LIB_FAN_HEALTH_H_
+#define LIB_FAN_HEALTH_H_
+#include <string>
+
+/*
+ * Per-channel fan stall detection, evaluated once per control cycle from
+ * the PWM and RPM values the daemon reads anyway.
+ *
+ * A fan driven at min_stop or more for a full cycle is stalled when:
+ *  - its fanN_alarm attribute is set, on chips providing one with a
+ *    non-zero fanN_min; the chip compares RPM itself, so while the alarm
+ *    is clear the RPM of a running fan is only read every
+ *    max_unread_cycles (see needs_speed()),
+ *  - otherwise, when its RPM falls under stall_ratio times the RPM
+ *    expected for its PWM, interpolated between (min_stop, min_speed) and
+ *    the last healthy (PWM, RPM) pair seen at a higher PWM.
+ */
+class fan_health {
+ public:
+  fan_health(const std::string &fan_sensor, long min_stop, long min_speed,
+             double stall_ratio);
+  ~fan_health();
+
+  fan_health(const fan_health &) = delete;
+  fan_health & operator=(const fan_health &) = delete;
+
+  static const unsigned int max_unread_cycles = 10;
+
+  // Whether check() needs a fresh RPM reading: always without fanN_alarm,
+  // otherwise for an unsettled fan, a set alarm or every max_unread_cycles.
+  // Reads the alarm.
+  bool needs_speed(long pwm);
+  // Returns whether the fan is stalled; when needs_speed() was false for
+  // this pwm, fan_speed may be the last non-zero reading
+  bool check(long pwm, long fan_speed);
+
+  long expected_speed(long pwm) const;
+  // New thresholds, e.g. after recalibration
+  void set_limits(long min_stop, long min_speed);
+  bool has_alarm() const { return alarm_fd >= 0; }
+
+ private:
+  bool read_alarm() const;
+
+  long min_stop;
+  long min_speed;
+  const double stall_ratio;
+  std::string alarm_path;
+  int alarm_fd;
+  int alarm;  // Read by needs_speed(), -1 when not
+  bool speed_unread;
+  unsigned int unread_cycles;
+
+  long last_pwm;
+  long reference_pwm;
+  long reference_speed;
+};
+#endif  // LIB_FAN_HEALTH_H_
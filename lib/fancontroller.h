@@ -1,7 +1,11 @@
 #ifndef LIB_FANCONTROLLER_H_
 #define LIB_FANCONTROLLER_H_
+#include <functional>
+#include <memory>
 #include <string>
 
+class io_uring_batch;
+
 class fancontroller {
  private:
   const std::string controller;
@@ -18,8 +22,15 @@ class fancontroller {
 
   const std::string controller_enabler;
 
-  long read_value(const std::string & path) const;
-  void write_value(const std::string & path, long val);
+  // Devices are opened once and read/written at offset 0
+  int controller_fd;
+  int fan_sensor_fd;
+  int temp_sensor_fd;
+  std::unique_ptr<io_uring_batch> uring;
+
+  long read_value(int fd, const std::string & path) const;
+  void write_value(int fd, const std::string & path, long val);
+  static long parse_value(const char * buf, long len, const std::string & path);
 
  public:
   fancontroller(const std::string &controller,
@@ -30,6 +41,13 @@ class fancontroller {
                 long min_pwm, long max_pwm);
   ~fancontroller();
 
+  fancontroller(const fancontroller &) = delete;
+  fancontroller & operator=(const fancontroller &) = delete;
+
+  // Batch the per-cycle reads through io_uring; throws std::runtime_error
+  // if unavailable, in which case pread() keeps being used
+  void use_io_uring();
+
   long get_min_temp()  const { return min_temp; }
   long get_max_temp()  const { return max_temp; }
   long get_min_start() const { return min_start;}
@@ -49,13 +67,18 @@ class fancontroller {
   long read_temperature() const;
   long read_fan_speed() const;
   long read_fan_pwm() const;
+  // All of the above, in a single submission when io_uring is used;
+  // fan_speed may be null to leave the fan sensor out
+  void read_state(long * temperature, long * pwm, long * fan_speed) const;
 
   void set_fan_pwm(long pwm);
 
   void set_full_speed();
-  void start_fan();
+  // From min_start up to max_pwm in at most start_steps steps, calling
+  // wait() between them; wait() returns false to give up
+  void start_fan(const std::function<bool()> &wait);
   void stop_fan();
 
-  long up_step;  // TODO: find a better place for this... Put there to avoid static bug in update();
+  static const long start_steps = 10;
 };
 #endif  // LIB_FANCONTROLLER_H_
@@ -0,0 +1,49 @@
+#ifndef LIB_HWMON_INDEX_H_
+#define LIB_HWMON_INDEX_H_
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * In-memory index of hwmon chips, built by a single scan of
+ * /sys/class/hwmon.
+ *
+ * Lets configuration refer to sensors and controls independently of the
+ * hwmonN numbering and platform device paths, which change between kernels
+ * and boots:
+ *  - chip:attribute, e.g. it87:pwm1, it87:fan1 (for fan1_input), or
+ *    hwmon2:temp3 when several chips have the same name; the attribute
+ *    type must be the one wanted
+ *  - label:text, e.g. label:CPU Fan, matched against *_label attributes;
+ *    a fanN label also designates pwmN when the chip has no pwmN_label
+ * Absolute paths are left untouched. Resolved paths are real paths, all
+ * lookups go through the index without walking directories again.
+ */
+class hwmon_index {
+ public:
+  explicit hwmon_index(const std::string &root = "/sys/class/hwmon");
+
+  // kind is the attribute type wanted: pwm, fan or temp
+  std::string resolve(const std::string &ref, const std::string &kind) const;
+
+  static bool is_reference(const std::string &ref) {
+    return !ref.empty() && ref[0] != '/';
+  }
+
+ private:
+  struct chip {
+    std::string id;    // hwmonN
+    std::string name;
+    std::string path;
+    std::map<std::string, std::string> attributes;  // name -> path
+    std::multimap<std::string, std::string> labels;  // text -> channel (fan1)
+  };
+
+  void scan_chip(chip * c, const std::string &dir) const;
+  const chip * find_chip(const std::string &name) const;
+  std::string attribute(const chip & c, const std::string &channel,
+                        const std::string &kind) const;
+
+  std::vector<chip> chips;
+};
+#endif  // LIB_HWMON_INDEX_H_
@@ -0,0 +1,54 @@
+#ifndef LIB_IO_URING_BATCH_H_
+#define LIB_IO_URING_BATCH_H_
+#include <cstddef>
+#include <cstdint>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/*
+ * Minimal io_uring wrapper submitting small batches of reads.
+ *
+ * Only what fancontroller needs: queue some requests, submit them with a
+ * single io_uring_enter() and wait for all completions. Not thread safe,
+ * each user owns its ring. The constructor throws std::runtime_error when
+ * io_uring is not available, callers are expected to fall back to pread().
+ */
+class io_uring_batch {
+ public:
+  explicit io_uring_batch(unsigned int entries);
+  ~io_uring_batch();
+
+  io_uring_batch(const io_uring_batch &) = delete;
+  io_uring_batch & operator=(const io_uring_batch &) = delete;
+
+  // Requests are positioned at offset 0, as sysfs attributes need
+  void prep_read(int fd, char * buf, unsigned int len);
+
+  // Submit queued requests, wait for them and store their result
+  // (byte count or -errno) in queuing order
+  void submit_and_wait(int * results);
+
+ private:
+  void prep(uint8_t opcode, int fd, uint64_t addr, unsigned int len);
+
+  int ring_fd;
+  unsigned int entries;
+  unsigned int queued;
+
+  void * sq_ptr;
+  std::size_t sq_size;
+  void * cq_ptr;
+  std::size_t cq_size;
+  io_uring_sqe * sqes;
+  std::size_t sqes_size;
+
+  unsigned int * sq_tail;
+  unsigned int * sq_mask;
+  unsigned int * sq_array;
+  unsigned int * cq_head;
+  unsigned int * cq_tail;
+  unsigned int * cq_mask;
+  io_uring_cqe * cqes;
+};
+#endif  // LIB_IO_URING_BATCH_H_
@@ -0,0 +1,52 @@
+#ifndef LIB_LOAD_MONITOR_H_
+#define LIB_LOAD_MONITOR_H_
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Cheap system load probe for feed-forward control.
+ *
+ * Returns a load in [0, 1] from one of:
+ *  - cpu:     utilization from /proc/stat since the previous sample
+ *  - cpufreq: current over maximum frequency, highest of all cpufreq
+ *             policies (so of all cores)
+ *  - rapl:    package power from RAPL energy counter, over full_power
+ * Its source is opened once and read with pread() on every sample.
+ */
+class load_monitor {
+ public:
+  load_monitor(const std::string &source, double full_power);
+  ~load_monitor();
+
+  load_monitor(const load_monitor &) = delete;
+  load_monitor & operator=(const load_monitor &) = delete;
+
+  double sample();
+
+ private:
+  enum source_type { cpu, cpufreq, rapl };
+  typedef std::chrono::steady_clock clock;
+
+  uint64_t read_counter(int file, const std::string &file_path) const;
+  double sample_cpu();
+  double sample_cpufreq();
+  double sample_rapl();
+
+  source_type type;
+  std::string path;
+  int fd;
+  double full_power;  // W, rapl only
+  std::vector<std::string> freq_paths;  // cpufreq only, one per policy
+  std::vector<int> freq_fds;
+  std::vector<double> max_freqs;        // kHz
+  uint64_t max_energy;  // uJ, wrap-around value of rapl counter
+
+  uint64_t last_busy;
+  uint64_t last_total;
+  double last_load;     // cpu only, kept when counters go backwards
+  uint64_t last_energy;
+  clock::time_point last_time;
+};
+#endif  // LIB_LOAD_MONITOR_H_
@@ -1,16 +1,16 @@
 #ifndef LIB_PIDFILE_H
 #define LIB_PIDFILE_H
-#include <boost/filesystem.hpp>
-namespace bfs = boost::filesystem;
+#include <sys/types.h>
+#include <string>
 
 class pidfile {
  public:
-  explicit pidfile(bfs::path pid_filepath);
+  explicit pidfile(const std::string &pid_filepath);
   ~pidfile();
   pid_t get_pid() const;
 
  private:
-  bfs::path pid_filepath;
+  std::string pid_filepath;
   pid_t pid;
 };
 
@@ -0,0 +1,60 @@
+#ifndef LIB_PROBES_H_
+#define LIB_PROBES_H_
+
+/*
+ * USDT static tracepoints, provider fancontrolcpp.
+ *
+ * Each probe is a single nop until a tracer attaches to it, so they are
+ * built in whenever <sys/sdt.h> (systemtap-sdt-dev) is available; define
+ * NO_USDT to leave them out. Arguments are integers or C strings, timings
+ * come from *_begin / *_done pairs, e.g.
+ *   bpftrace -e 'usdt:/usr/sbin/fancontrolcpp:read_begin { @t[tid] = nsecs }
+ *     usdt:/usr/sbin/fancontrolcpp:read_done /@t[tid]/ {
+ *       @us[str(arg1)] = hist((nsecs - @t[tid]) / 1000); delete(@t[tid]) }'
+ *
+ * fancontroller (path is the device file)
+ *   read_begin(fd, path)             read_done(fd, path, value)
+ *   write_begin(fd, path, value)     write_done(fd, path, value)
+ *   batch_begin(count)               batch_done(count)
+ *   start_fan_begin(path, pwm)       start_fan_step(path, pwm, fan_speed)
+ *   start_fan_done(path, pwm)        stop_fan_begin(path)
+ *   stop_fan_done(path)
+ * fancontrolcpp (id is the channel number)
+ *   cycle_begin(id)                  cycle_done(id, overrun_us)
+ *   update_read(id, temperature, pwm, fan_speed)
+ *   update_computed(id, temperature, pwm)   curve output
+ *   update_filtered(id, pwm)                pipeline output
+ *   update_zeroed(id, computed_pwm)         fan kept or put to stop
+ *   update_boosted(id, pwm)                 stall of the fan or a sibling
+ *   update_start(id, pwm)                   start_fan() needed
+ *   update_applied(id, pwm)                 PWM written
+ *   reprobe_step(id, pwm, fan_speed)
+ *   failsafe_trip(path)
+ * calibrate-fancontrolcpp (phase 0 downward, 1 upward)
+ *   calibrate_step(phase, pwm, fan_speed, temperature)
+ *   calibrate_done(min_start, min_stop, min_speed, min_temp)
+ */
+
+#if !defined(NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define FC_USDT 1
+#endif
+#endif
+
+#if defined(FC_USDT)
+#include <sys/sdt.h>
+#define FC_PROBE0(name) DTRACE_PROBE(fancontrolcpp, name)
+#define FC_PROBE1(name, a1) DTRACE_PROBE1(fancontrolcpp, name, a1)
+#define FC_PROBE2(name, a1, a2) DTRACE_PROBE2(fancontrolcpp, name, a1, a2)
+#define FC_PROBE3(name, a1, a2, a3) \
+  DTRACE_PROBE3(fancontrolcpp, name, a1, a2, a3)
+#define FC_PROBE4(name, a1, a2, a3, a4) \
+  DTRACE_PROBE4(fancontrolcpp, name, a1, a2, a3, a4)
+#else
+#define FC_PROBE0(name) do {} while (0)
+#define FC_PROBE1(name, a1) do {} while (0)
+#define FC_PROBE2(name, a1, a2) do {} while (0)
+#define FC_PROBE3(name, a1, a2, a3) do {} while (0)
+#define FC_PROBE4(name, a1, a2, a3, a4) do {} while (0)
+#endif
+#endif  // LIB_PROBES_H_
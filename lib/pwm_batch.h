@@ -0,0 +1,30 @@
+#ifndef LIB_PWM_BATCH_H_
+#define LIB_PWM_BATCH_H_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "pwm_curve.h"
+
+/*
+ * Structure-of-arrays evaluation of many channels at once: hysteresis,
+ * PWM adjusting function with its clamping, then ramp filtering, as done
+ * channel by channel in the daemon. Meant for large configurations and
+ * trace replay tools; results are identical to the scalar path.
+ */
+class pwm_batch {
+ public:
+  void add(const pwm_curve & curve, int32_t temp_hyst);
+  std::size_t size() const { return min_temp.size(); }
+
+  // All arrays hold size() elements; up_step is updated in place
+  void compute(const int32_t * temperature, int32_t * computed_pwm) const;
+  void update(const int32_t * temperature, const int32_t * cur_pwm,
+              const int32_t * cur_fan_speed, int32_t * up_step,
+              int32_t * new_pwm) const;
+
+ private:
+  std::vector<double> min_temp, max_temp, min_pwm, max_pwm, min_stop, k1, k2;
+  std::vector<int32_t> min_stop_pwm, temp_hyst;
+};
+#endif  // LIB_PWM_BATCH_H_
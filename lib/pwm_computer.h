@@ -0,0 +1,39 @@
+#ifndef LIB_PWM_COMPUTER_H_
+#define LIB_PWM_COMPUTER_H_
+#include "fancontroller.h"
+#include "pwm_curve.h"
+
+class pwm_computer {
+ public:
+  virtual ~pwm_computer() {}
+  long pwm_for(long temperature) const {
+    return pwm_curve_target(curve, static_cast<int32_t>(temperature));
+  }
+  const pwm_curve & get_curve() const { return curve; }
+  // Follow a new min_stop, e.g. after recalibration
+  void retune(long min_stop);
+ protected:
+  pwm_computer(long min_temp, long max_temp,
+               long min_stop, long min_pwm, long max_pwm);
+  virtual void fit() = 0;
+  pwm_curve curve;
+};
+
+class linear_pwm_computer : public pwm_computer {
+ public:
+  explicit linear_pwm_computer(const fancontroller * const fc);
+  linear_pwm_computer(long min_temp, long max_temp,
+                      long min_stop, long min_pwm, long max_pwm);
+ protected:
+  void fit();
+};
+
+class quadratic_pwm_computer : public pwm_computer {
+ public:
+  explicit quadratic_pwm_computer(const fancontroller * const fc);
+  quadratic_pwm_computer(long min_temp, long max_temp,
+                         long min_stop, long min_pwm, long max_pwm);
+ protected:
+  void fit();
+};
+#endif  // LIB_PWM_COMPUTER_H_
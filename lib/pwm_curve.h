@@ -0,0 +1,61 @@
+#ifndef LIB_PWM_CURVE_H_
+#define LIB_PWM_CURVE_H_
+#include <cstdint>
+
+/*
+ * Per-channel computations shared by the daemon and pwm_batch, so that the
+ * scalar and batch paths give identical results by construction.
+ *
+ * Written branch-free on plain values so that pwm_batch loops over them
+ * get auto-vectorized. Functions are static: pwm_batch.cpp is built with
+ * other flags, each translation unit keeps its own copy.
+ */
+
+// PWM adjusting function: min_stop + (k2 * x + k1) * x, x = t - min_temp,
+// with min_pwm applied below min_temp and max_pwm above max_temp
+struct pwm_curve {
+  double min_temp;
+  double max_temp;
+  double min_pwm;
+  double max_pwm;
+  double min_stop;
+  double k1;
+  double k2;
+};
+
+static inline int32_t pwm_curve_target(double min_temp, double max_temp,
+                                       double min_pwm, double max_pwm,
+                                       double min_stop, double k1, double k2,
+                                       int32_t temperature) {
+  double t = static_cast<double>(temperature);
+  double x = t - min_temp;
+  double pwm = min_stop + (k2 * x + k1) * x;
+  pwm = t < min_temp ? min_pwm : pwm;
+  pwm = t > max_temp ? max_pwm : pwm;
+  return static_cast<int32_t>(pwm);
+}
+
+static inline int32_t pwm_curve_target(const pwm_curve & c,
+                                       int32_t temperature) {
+  return pwm_curve_target(c.min_temp, c.max_temp, c.min_pwm, c.max_pwm,
+                          c.min_stop, c.k1, c.k2, temperature);
+}
+
+// Progressive and growing increase, unlimited decrease. A stopped fan is
+// kept stopped below min_stop, with up_step doubled to avoid staying
+// stopped for too long if it should normally be running.
+static inline int32_t pwm_ramp(int32_t computed_pwm, int32_t cur_pwm,
+                               int32_t cur_fan_speed, int32_t min_stop,
+                               int32_t * up_step) {
+  int32_t rising = computed_pwm > cur_pwm;
+  int32_t step = rising ? *up_step + 1 : 0;
+  int32_t new_pwm = rising ? cur_pwm + step : computed_pwm;
+  int32_t reached = new_pwm >= computed_pwm;
+  new_pwm = reached ? computed_pwm : new_pwm;
+  step = reached ? 0 : step;
+
+  int32_t zeroed = !cur_fan_speed && new_pwm < min_stop;
+  *up_step = zeroed ? step * 2 : step;
+  return zeroed ? 0 : new_pwm;
+}
+#endif  // LIB_PWM_CURVE_H_
@@ -0,0 +1,235 @@
+#ifndef LIB_PWM_FILTERS_H_
+#define LIB_PWM_FILTERS_H_
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <tuple>
+#include <utility>
+
+#include "pwm_curve.h"
+#include "temperature_estimator.h"
+
+/*
+ * Composable stages computing a new PWM value from a sensors sample.
+ *
+ * Each stage is a small function object updating the sample in place;
+ * filter_pipeline chains them at compile time so that a whole channel
+ * pipeline gets inlined, without any virtual call between stages. Stages
+ * before curve work on the temperature, the ones after it on the PWM.
+ */
+
+struct filter_sample {
+  double now;          // Monotonic time, in seconds
+  long temperature;
+  double temp_rate;    // Per second, when estimated
+  long fan_speed;
+  long cur_pwm;        // PWM currently applied
+  long computed;       // PWM given by the curve
+  long pwm;            // PWM being computed
+  long min_stop;       // Lowest PWM keeping the fan rotating
+  double load;         // System load in [0, 1], for feed-forward
+};
+
+// Replace noisy readings by their Kalman estimate, optionally predicted
+// horizon seconds ahead. Disabled filters leave readings untouched.
+class estimator_filter {
+ public:
+  estimator_filter(bool enabled, double sensor_noise, double accel_noise,
+                   double horizon)
+    : enabled(enabled), horizon(horizon),
+      estimator(sensor_noise, accel_noise) {}
+  void operator()(filter_sample & s) {
+    if (!enabled)
+      return;
+    estimator.update(s.now, static_cast<double>(s.temperature));
+    s.temp_rate = estimator.get_rate();
+    double estimate = estimator.predict(horizon);
+    s.temperature = static_cast<long>(estimate < 0.0 ? estimate - 0.5
+                                                     : estimate + 0.5);
+  }
+ private:
+  bool enabled;
+  double horizon;
+  temperature_estimator estimator;
+};
+
+// Lower temperature by temp_hyst while the fan is stopped
+class hysteresis_filter {
+ public:
+  explicit hysteresis_filter(long temp_hyst) : temp_hyst(temp_hyst) {}
+  void operator()(filter_sample & s) {
+    if (!s.fan_speed)
+      s.temperature -= temp_hyst;
+  }
+ private:
+  long temp_hyst;
+};
+
+// PWM adjusting function, followed when retuned
+class curve_filter {
+ public:
+  explicit curve_filter(const pwm_curve * curve) : curve(curve) {}
+  void operator()(filter_sample & s) {
+    s.pwm = s.computed =
+      pwm_curve_target(*curve, static_cast<int32_t>(s.temperature));
+  }
+ private:
+  const pwm_curve * curve;
+};
+
+// Add a PWM bias proportional to the rise of load over its recent average,
+// so that fans spin up before temperature follows. The average catches up
+// with a factor alpha per cycle, making the bias decay. Gain 0 disables it.
+// Placed after smoothing and rate limiting stages so that the bias applies
+// at once, and only to a non-zero PWM.
+class feed_forward_filter {
+ public:
+  feed_forward_filter(double gain, double alpha, long max_pwm)
+    : gain(gain), alpha(alpha), max_pwm(max_pwm), average(-1.0) {}
+  void operator()(filter_sample & s) {
+    if (!gain)
+      return;
+    if (average < 0.0)
+      average = s.load;
+    double rise = s.load - average;
+    average += alpha * rise;
+    if (rise > 0.0 && s.pwm) {
+      s.pwm += static_cast<long>(gain * rise);
+      if (s.pwm > max_pwm)
+        s.pwm = max_pwm;
+    }
+  }
+ private:
+  double gain;
+  double alpha;
+  long max_pwm;
+  double average;
+};
+
+// Former update() behaviour: progressive and growing increase, unlimited
+// decrease, fan kept stopped below min_stop (see pwm_ramp())
+class ramp_filter {
+ public:
+  ramp_filter() : up_step(0) {}
+  void operator()(filter_sample & s) {
+    s.pwm = pwm_ramp(static_cast<int32_t>(s.pwm),
+                     static_cast<int32_t>(s.cur_pwm),
+                     static_cast<int32_t>(s.fan_speed),
+                     static_cast<int32_t>(s.min_stop), &up_step);
+  }
+ private:
+  int32_t up_step;
+};
+
+// Exponential moving average of the computed PWM, alpha = 1 disables it
+class ema_filter {
+ public:
+  explicit ema_filter(double alpha) : alpha(alpha), value(-1.0) {}
+  void operator()(filter_sample & s) {
+    if (value < 0.0)
+      value = static_cast<double>(s.pwm);
+    else
+      value += alpha * (static_cast<double>(s.pwm) - value);
+    s.pwm = static_cast<long>(value + 0.5);
+  }
+ private:
+  double alpha;
+  double value;
+};
+
+// Keep the current PWM of a running fan for changes smaller than deadband
+class deadband_filter {
+ public:
+  explicit deadband_filter(long deadband) : deadband(deadband) {}
+  void operator()(filter_sample & s) {
+    if (s.fan_speed && s.pwm && std::labs(s.pwm - s.cur_pwm) < deadband)
+      s.pwm = s.cur_pwm;
+  }
+ private:
+  long deadband;
+};
+
+// Limit PWM change per cycle of a running fan, 0 means unlimited
+class slew_filter {
+ public:
+  slew_filter(long rise_step, long fall_step)
+    : rise_step(rise_step), fall_step(fall_step) {}
+  void operator()(filter_sample & s) {
+    if (!s.fan_speed)
+      return;
+    if (rise_step && s.pwm > s.cur_pwm + rise_step)
+      s.pwm = s.cur_pwm + rise_step;
+    if (fall_step && s.pwm && s.pwm < s.cur_pwm - fall_step)
+      s.pwm = s.cur_pwm - fall_step;
+  }
+ private:
+  long rise_step;
+  long fall_step;
+};
+
+// Do not try to run a stopped fan below min_stop
+class stop_filter {
+ public:
+  void operator()(filter_sample & s) {
+    if (!s.fan_speed && s.pwm < s.min_stop)
+      s.pwm = 0;
+  }
+};
+
+// Keep a started fan running for at least min_on seconds (at min_stop),
+// and a stopped one stopped for at least min_off seconds
+class min_on_off_filter {
+ public:
+  min_on_off_filter(double min_on, double min_off)
+    : min_on(min_on), min_off(min_off),
+      running(false), since(-min_on - min_off) {}
+  void operator()(filter_sample & s) {
+    if (running && !s.pwm && s.now - since < min_on)
+      s.pwm = s.min_stop;
+    else if (!running && s.pwm && s.now - since < min_off)
+      s.pwm = 0;
+    if (running != static_cast<bool>(s.pwm)) {
+      running = s.pwm;
+      since = s.now;
+    }
+  }
+ private:
+  double min_on;
+  double min_off;
+  bool running;
+  double since;
+};
+
+template<typename... Stages>
+class filter_pipeline {
+ public:
+  explicit filter_pipeline(Stages... stages) : stages(stages...) {}
+
+  long operator()(filter_sample & s) {
+    apply(s, std::index_sequence_for<Stages...>());
+    return s.pwm;
+  }
+
+ private:
+  template<std::size_t... I>
+  void apply(filter_sample & s, std::index_sequence<I...>) {
+    // Stages in order; C++14 lacks fold expressions
+    int order[] = {0, (std::get<I>(stages)(s), 0)...};
+    static_cast<void>(order);
+  }
+
+  std::tuple<Stages...> stages;
+};
+
+// Behaviour of fancontrolcpp before filters were configurable (with no
+// estimator and no feed-forward gain)
+typedef filter_pipeline<estimator_filter, hysteresis_filter, curve_filter,
+                        ramp_filter, feed_forward_filter>
+  legacy_pipeline;
+
+// Less PWM writes: smoothing, deadband, bounded slopes and min on/off times
+typedef filter_pipeline<estimator_filter, hysteresis_filter, curve_filter,
+                        ema_filter, deadband_filter, slew_filter,
+                        feed_forward_filter, stop_filter, min_on_off_filter>
+  damped_pipeline;
+#endif  // LIB_PWM_FILTERS_H_
@@ -0,0 +1,119 @@
+#ifndef LIB_RPM_MODEL_H_
+#define LIB_RPM_MODEL_H_
+
+/*
+ * Exponentially weighted least-squares fit of RPM = a + b * PWM.
+ *
+ * Only five running sums are kept; older samples fade by forgetting at
+ * each new one, so memory is bounded and the fit follows a wearing fan.
+ */
+class rpm_model {
+ public:
+  explicit rpm_model(double forgetting)
+    : forgetting(forgetting), sw(0.0), sx(0.0), sy(0.0), sxx(0.0), sxy(0.0) {}
+
+  void add(double pwm, double rpm) {
+    sw  = forgetting * sw  + 1.0;
+    sx  = forgetting * sx  + pwm;
+    sy  = forgetting * sy  + rpm;
+    sxx = forgetting * sxx + pwm * pwm;
+    sxy = forgetting * sxy + pwm * rpm;
+  }
+
+  double weight() const { return sw; }
+  double mean_pwm() const { return sx / sw; }
+  double mean_rpm() const { return sy / sw; }
+  double pwm_variance() const {
+    return sxx / sw - mean_pwm() * mean_pwm();
+  }
+
+  // Enough samples over a wide enough PWM range for the slope to mean
+  // something
+  bool fitted(double min_weight, double min_pwm_variance) const {
+    return sw >= min_weight && pwm_variance() >= min_pwm_variance;
+  }
+
+  double slope() const {
+    return (sxy / sw - mean_pwm() * mean_rpm()) / pwm_variance();
+  }
+  double predict(double pwm) const {
+    return mean_rpm() + slope() * (pwm - mean_pwm());
+  }
+
+ private:
+  double forgetting;
+  double sw, sx, sy, sxx, sxy;
+};
+
+/*
+ * Compares the live PWM -> RPM fit of a fan with its calibration point,
+ * min_speed RPM at min_stop, as found in the configuration (and again
+ * after each recalibration), so that wear across restarts shows too.
+ * Drift is the relative RPM difference between the fit and the line
+ * through that point, at the current operating point; the slope is taken
+ * from the first good fit, and not needed while the fan runs at min_stop.
+ * Only steady samples are used: fan running at the same PWM as on the
+ * previous cycle.
+ */
+class drift_monitor {
+ public:
+  drift_monitor(double threshold, long min_stop, long min_speed)
+    : threshold(threshold), model(forgetting), anchor_pwm(min_stop),
+      anchor_rpm(min_speed), slope(0.0), has_slope(false), last_pwm(-1),
+      drift(0.0) {}
+
+  // Returns whether the fan has drifted beyond threshold
+  bool observe(long pwm, long rpm) {
+    bool steady = pwm == last_pwm && rpm > 0;
+    last_pwm = pwm;
+    if (!steady)
+      return drifted();
+
+    model.add(static_cast<double>(pwm), static_cast<double>(rpm));
+    if (!has_slope && model.fitted(min_weight, min_pwm_variance)) {
+      slope = model.slope();
+      has_slope = true;
+    }
+    if (model.weight() < min_weight)
+      return drifted();
+    double offset = model.mean_pwm() - anchor_pwm;
+    if (!has_slope && (offset < -anchor_range || offset > anchor_range))
+      return drifted();
+    double expected = anchor_rpm + (has_slope ? slope * offset : 0.0);
+    if (expected > 0.0) {
+      double diff = model.mean_rpm() - expected;
+      drift = (diff < 0.0 ? -diff : diff) / expected;
+    }
+    return drifted();
+  }
+
+  bool drifted() const { return drift > threshold; }
+  double get_drift() const { return drift; }
+
+  // Compare with the new calibration point, after thresholds were probed
+  // again
+  void rebaseline(long min_stop, long min_speed) {
+    anchor_pwm = static_cast<double>(min_stop);
+    anchor_rpm = static_cast<double>(min_speed);
+    has_slope = false;
+    drift = 0.0;
+  }
+
+ private:
+  // About 200 samples of memory
+  static constexpr double forgetting = 0.995;
+  static constexpr double min_weight = 20.0;
+  static constexpr double min_pwm_variance = 25.0;
+  // How far from min_stop the fan may run without a slope
+  static constexpr double anchor_range = 2.0;
+
+  double threshold;
+  rpm_model model;
+  double anchor_pwm;
+  double anchor_rpm;
+  double slope;
+  bool has_slope;
+  long last_pwm;
+  double drift;
+};
+#endif  // LIB_RPM_MODEL_H_
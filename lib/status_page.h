@@ -0,0 +1,123 @@
+#ifndef LIB_STATUS_PAGE_H_
+#define LIB_STATUS_PAGE_H_
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Shared-memory status page, /dev/shm/fancontrolcpp by default.
+ *
+ * Lets any number of local readers get the latest values of each channel
+ * without a syscall and without touching hwmon devices. The file is a
+ * header followed by channel_count channel entries, in native byte order.
+ * Each entry is a seqlock written once per cycle by its channel worker
+ * only: its sequence is odd while being written, readers copy the entry
+ * and retry when the sequence was odd or changed meanwhile.
+ *
+ * The layout only grows at the end of the structures; readers check
+ * magic and version, and use header_size and channel_size as strides.
+ */
+
+static const char STATUS_PAGE_PATH[] = "/dev/shm/fancontrolcpp";
+static const uint32_t STATUS_PAGE_MAGIC = 0x53504346;  // "FCPS"
+static const uint32_t STATUS_PAGE_VERSION = 1;
+
+// Channel flags
+static const uint32_t STATUS_FAULTED = 1u << 0;
+static const uint32_t STATUS_STALLED = 1u << 1;
+static const uint32_t STATUS_DRIFTED = 1u << 2;
+static const uint32_t STATUS_BOOSTED = 1u << 3;
+
+struct status_page_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t channel_size;
+  uint32_t channel_count;
+  std::atomic<uint32_t> running;  // Cleared on daemon exit
+  int64_t pid;
+  int64_t started;                // CLOCK_REALTIME, in ns
+  uint8_t reserved[24];
+};
+
+struct status_page_channel {
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint32_t> id;
+  std::atomic<uint32_t> flags;
+  std::atomic<int64_t> updated;   // CLOCK_REALTIME, in ns
+  std::atomic<int64_t> temperature;
+  std::atomic<int64_t> fan_speed;
+  std::atomic<int64_t> pwm;
+  std::atomic<uint64_t> cycles;
+  std::atomic<uint64_t> overruns;
+  std::atomic<uint64_t> faults;
+  std::atomic<uint64_t> stalls;
+  std::atomic<uint64_t> recalibrations;
+  uint8_t reserved[40];
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "status page needs lock-free atomics to be shared");
+static_assert(sizeof(status_page_header) == 64, "status page layout");
+static_assert(sizeof(status_page_channel) == 128, "status page layout");
+
+// Plain copy of a channel entry
+struct status_snapshot {
+  uint32_t id;
+  uint32_t flags;
+  int64_t updated;
+  int64_t temperature;
+  int64_t fan_speed;
+  int64_t pwm;
+  uint64_t cycles;
+  uint64_t overruns;
+  uint64_t faults;
+  uint64_t stalls;
+  uint64_t recalibrations;
+};
+
+// Creates and maps the page. Throws std::runtime_error.
+class status_page {
+ public:
+  status_page(const std::string &path, unsigned int channel_count);
+  ~status_page();
+
+  status_page(const status_page &) = delete;
+  status_page & operator=(const status_page &) = delete;
+
+  // Only one writer per index
+  void publish(unsigned int index, const status_snapshot &snapshot);
+
+ private:
+  std::string path;
+  void * map;
+  std::size_t size;
+  status_page_header * header;
+  status_page_channel * channels;
+};
+
+// Maps an existing page read-only. Throws std::runtime_error.
+class status_page_reader {
+ public:
+  explicit status_page_reader(const std::string &path);
+  ~status_page_reader();
+
+  status_page_reader(const status_page_reader &) = delete;
+  status_page_reader & operator=(const status_page_reader &) = delete;
+
+  bool running() const { return header->running.load(); }
+  int64_t get_pid() const { return header->pid; }
+  unsigned int get_channel_count() const { return channel_count; }
+
+  // Consistent copy of a channel entry
+  status_snapshot read(unsigned int index) const;
+
+ private:
+  const void * map;
+  std::size_t size;
+  const status_page_header * header;
+  std::size_t channel_size;
+  unsigned int channel_count;
+};
+#endif  // LIB_STATUS_PAGE_H_
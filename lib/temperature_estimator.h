@@ -0,0 +1,66 @@
+#ifndef LIB_TEMPERATURE_ESTIMATOR_H_
+#define LIB_TEMPERATURE_ESTIMATOR_H_
+
+/*
+ * Constant-velocity Kalman filter on temperature readings.
+ *
+ * State is temperature and its rate of change, process noise is a random
+ * acceleration of standard deviation accel_noise (unit/s^2), readings have
+ * a standard deviation of sensor_noise. Plain doubles, no allocation.
+ */
+class temperature_estimator {
+ public:
+  temperature_estimator(double sensor_noise, double accel_noise)
+    : r(sensor_noise * sensor_noise), q(accel_noise * accel_noise),
+      initialized(false), last_time(0.0), temp(0.0), rate(0.0),
+      p00(0.0), p01(0.0), p11(0.0) {}
+
+  void update(double time, double reading) {
+    if (!initialized) {
+      initialized = true;
+      last_time = time;
+      temp = reading;
+      rate = 0.0;
+      p00 = r;
+      p01 = 0.0;
+      p11 = r;  // Unknown rate: one noise unit per second
+      return;
+    }
+
+    // Predict
+    double dt = time - last_time;
+    last_time = time;
+    temp += rate * dt;
+    double dt2 = dt * dt;
+    double n00 = p00 + dt * (2.0 * p01 + dt * p11) + q * dt2 * dt2 / 4.0;
+    double n01 = p01 + dt * p11 + q * dt2 * dt / 2.0;
+    double n11 = p11 + q * dt2;
+
+    // Correct
+    double s = n00 + r;
+    double k0 = n00 / s;
+    double k1 = n01 / s;
+    double innovation = reading - temp;
+    temp += k0 * innovation;
+    rate += k1 * innovation;
+    p00 = (1.0 - k0) * n00;
+    p01 = (1.0 - k0) * n01;
+    p11 = n11 - k1 * n01;
+  }
+
+  double get_temperature() const { return temp; }
+  double get_rate() const { return rate; }
+  double predict(double horizon) const { return temp + rate * horizon; }
+
+ private:
+  const double r;
+  const double q;
+
+  bool initialized;
+  double last_time;
+  double temp;
+  double rate;
+  // Symmetric covariance
+  double p00, p01, p11;
+};
+#endif  // LIB_TEMPERATURE_ESTIMATOR_H_
@@ -0,0 +1,155 @@
+#include "lib/load_monitor.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+static const std::string PROC_STAT("/proc/stat");
+static const std::string CPUFREQ("/sys/devices/system/cpu/cpufreq/");
+static const std::string CPU0_CPUFREQ("/sys/devices/system/cpu/cpu0/cpufreq");
+static const std::string RAPL("/sys/class/powercap/intel-rapl:0/");
+
+static int open_source(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Could not open load source " + path + "!");
+  return fd;
+}
+
+load_monitor::load_monitor(const std::string &source, double full_power)
+  : fd(-1), full_power(full_power), max_energy(0),
+    last_busy(0), last_total(0), last_load(0.0), last_energy(0),
+    last_time(clock::now()) {
+  if (source == "cpu") {
+    type = cpu;
+    path = PROC_STAT;
+  } else if (source == "cpufreq") {
+    type = cpufreq;
+    // policyN directories, or cpu0 only on kernels without them
+    std::vector<std::string> dirs;
+    if (DIR * dir = opendir(CPUFREQ.c_str())) {
+      while (const dirent * entry = readdir(dir))
+        if (std::string(entry->d_name).compare(0, 6, "policy") == 0)
+          dirs.push_back(CPUFREQ + entry->d_name);
+      closedir(dir);
+    }
+    if (dirs.empty())
+      dirs.push_back(CPU0_CPUFREQ);
+    for (const std::string &dir : dirs) {
+      int max_fd = open_source(dir + "/cpuinfo_max_freq");
+      double max_freq = static_cast<double>(
+          read_counter(max_fd, dir + "/cpuinfo_max_freq"));
+      close(max_fd);
+      freq_paths.push_back(dir + "/scaling_cur_freq");
+      freq_fds.push_back(open_source(freq_paths.back()));
+      max_freqs.push_back(max_freq);
+    }
+  } else if (source == "rapl") {
+    if (full_power <= 0.0)
+      throw std::runtime_error("RAPL load source needs a full power value!");
+    type = rapl;
+    path = RAPL + "energy_uj";
+    int max_fd = open_source(RAPL + "max_energy_range_uj");
+    max_energy = read_counter(max_fd, RAPL + "max_energy_range_uj");
+    close(max_fd);
+  } else {
+    throw std::runtime_error("Unknown load source " + source + "!");
+  }
+  if (type != cpufreq)
+    fd = open_source(path);
+  // Prime counters, so that the first sample is meaningful
+  sample();
+}
+
+load_monitor::~load_monitor() {
+  if (fd >= 0)
+    close(fd);
+  for (int freq_fd : freq_fds)
+    close(freq_fd);
+}
+
+uint64_t load_monitor::read_counter(int file,
+                                   const std::string &file_path) const {
+  char buf[32];
+  ssize_t len = pread(file, buf, sizeof(buf) - 1, 0);
+  if (len <= 0)
+    throw std::runtime_error("Unable to read " + file_path + "!");
+  buf[len] = '\0';
+  return std::strtoull(buf, nullptr, 10);
+}
+
+double load_monitor::sample() {
+  switch (type) {
+    case cpu:
+      return sample_cpu();
+    case cpufreq:
+      return sample_cpufreq();
+    case rapl:
+      return sample_rapl();
+  }
+  return 0.0;
+}
+
+// First line: cpu user nice system idle iowait irq softirq steal ...
+double load_monitor::sample_cpu() {
+  char buf[256];
+  ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0)
+    throw std::runtime_error("Unable to read " + path + "!");
+  buf[len] = '\0';
+
+  const char * p = buf + 3;  // "cpu"
+  uint64_t total = 0, idle = 0;
+  for (int i = 0; i < 8; ++i) {
+    char * end;
+    uint64_t val = std::strtoull(p, &end, 10);
+    if (end == p)
+      break;
+    total += val;
+    if (i == 3 || i == 4)  // idle, iowait
+      idle += val;
+    p = end;
+  }
+  uint64_t busy = total - idle;
+
+  // iowait is allowed to go backwards: keep the previous load rather than
+  // wrap around, and clamp when it inflates busy time
+  if (total > last_total && busy >= last_busy) {
+    double load = static_cast<double>(busy - last_busy) /
+                  static_cast<double>(total - last_total);
+    last_load = load < 1.0 ? load : 1.0;
+  }
+  last_busy = busy;
+  last_total = total;
+  return last_load;
+}
+
+// Boost frequencies exceed cpuinfo_max_freq: clamped
+double load_monitor::sample_cpufreq() {
+  double load = 0.0;
+  for (std::size_t i = 0; i < freq_fds.size(); ++i) {
+    if (max_freqs[i] <= 0.0)
+      continue;
+    double freq = static_cast<double>(read_counter(freq_fds[i], freq_paths[i]));
+    load = std::max(load, std::min(freq / max_freqs[i], 1.0));
+  }
+  return load;
+}
+
+double load_monitor::sample_rapl() {
+  uint64_t energy = read_counter(fd, path);
+  clock::time_point now = clock::now();
+  uint64_t delta = energy >= last_energy ?
+    energy - last_energy : max_energy - last_energy + energy;
+  double seconds = std::chrono::duration<double>(now - last_time).count();
+  last_energy = energy;
+  last_time = now;
+  if (seconds <= 0.0)
+    return 0.0;
+  double power = static_cast<double>(delta) / 1e6 / seconds;
+  return power < full_power ? power / full_power : 1.0;
+}
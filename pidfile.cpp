@@ -2,39 +2,36 @@
 
 #include <unistd.h>
 
+#include <fstream>
 #include <string>
 #include <stdexcept>
 
-#include <boost/filesystem.hpp>
-#include <boost/filesystem/fstream.hpp>
-namespace bfs = boost::filesystem;
-
-pidfile::pidfile(bfs::path pid_filepath)
+pidfile::pidfile(const std::string &pid_filepath)
   : pid_filepath(pid_filepath)
 {
   pid = getpid();
-  if (bfs::exists(pid_filepath)) {
-    pid_t old_pid;
-    bfs::ifstream(pid_filepath) >> old_pid;
-    bfs::path old_comm_path("/proc/" + std::to_string(old_pid) + "/comm");
-    if (bfs::exists(old_comm_path)) {
+  if (access(pid_filepath.c_str(), F_OK) == 0) {
+    pid_t old_pid = 0;
+    std::ifstream(pid_filepath) >> old_pid;
+    std::string old_comm_path("/proc/" + std::to_string(old_pid) + "/comm");
+    if (old_pid > 0 && access(old_comm_path.c_str(), F_OK) == 0) {
       std::string self_name;
-      bfs::ifstream("/proc/self/comm") >> self_name;
+      std::ifstream("/proc/self/comm") >> self_name;
       std::string old_name;
-      bfs::ifstream(old_comm_path) >> old_name;
+      std::ifstream(old_comm_path) >> old_name;
       if (self_name == old_name) {
         throw std::runtime_error("Already running!");
       }
     }
-    bfs::remove(pid_filepath);
+    unlink(pid_filepath.c_str());
   }
-  bfs::ofstream out(pid_filepath);
+  std::ofstream out(pid_filepath);
   out << pid;
   out.close();
 }
 
 pidfile::~pidfile() {
-  bfs::remove(pid_filepath);
+  unlink(pid_filepath.c_str());
 }
 
 pid_t pidfile::get_pid() const {
@@ -0,0 +1,67 @@
+#include "lib/pwm_batch.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Built with -O3 -fno-trapping-math (see Makefile) so that the selects in
+// pwm_curve.h get if-converted; AVX2 is used when the CPU supports it.
+// Neither changes results: no FMA contraction, no reassociation.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define PWM_BATCH_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define PWM_BATCH_CLONES
+#endif
+
+void pwm_batch::add(const pwm_curve & curve, int32_t hyst) {
+  min_temp.push_back(curve.min_temp);
+  max_temp.push_back(curve.max_temp);
+  min_pwm.push_back(curve.min_pwm);
+  max_pwm.push_back(curve.max_pwm);
+  min_stop.push_back(curve.min_stop);
+  k1.push_back(curve.k1);
+  k2.push_back(curve.k2);
+  min_stop_pwm.push_back(static_cast<int32_t>(curve.min_stop));
+  temp_hyst.push_back(hyst);
+}
+
+PWM_BATCH_CLONES
+void pwm_batch::compute(const int32_t * __restrict temperature,
+                        int32_t * __restrict computed_pwm) const {
+  const std::size_t n = size();
+  const double * __restrict lo = min_temp.data();
+  const double * __restrict hi = max_temp.data();
+  const double * __restrict pwm_lo = min_pwm.data();
+  const double * __restrict pwm_hi = max_pwm.data();
+  const double * __restrict base = min_stop.data();
+  const double * __restrict a1 = k1.data();
+  const double * __restrict a2 = k2.data();
+  for (std::size_t i = 0; i < n; ++i)
+    computed_pwm[i] = pwm_curve_target(lo[i], hi[i], pwm_lo[i], pwm_hi[i],
+                                       base[i], a1[i], a2[i], temperature[i]);
+}
+
+PWM_BATCH_CLONES
+void pwm_batch::update(const int32_t * __restrict temperature,
+                       const int32_t * __restrict cur_pwm,
+                       const int32_t * __restrict cur_fan_speed,
+                       int32_t * __restrict up_step,
+                       int32_t * __restrict new_pwm) const {
+  const std::size_t n = size();
+  const double * __restrict lo = min_temp.data();
+  const double * __restrict hi = max_temp.data();
+  const double * __restrict pwm_lo = min_pwm.data();
+  const double * __restrict pwm_hi = max_pwm.data();
+  const double * __restrict base = min_stop.data();
+  const double * __restrict a1 = k1.data();
+  const double * __restrict a2 = k2.data();
+  const int32_t * __restrict stop = min_stop_pwm.data();
+  const int32_t * __restrict hyst = temp_hyst.data();
+  for (std::size_t i = 0; i < n; ++i) {
+    int32_t temp = cur_fan_speed[i] ? temperature[i]
+                                    : temperature[i] - hyst[i];
+    int32_t computed = pwm_curve_target(lo[i], hi[i], pwm_lo[i], pwm_hi[i],
+                                        base[i], a1[i], a2[i], temp);
+    new_pwm[i] = pwm_ramp(computed, cur_pwm[i], cur_fan_speed[i], stop[i],
+                          &up_step[i]);
+  }
+}
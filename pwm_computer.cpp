@@ -0,0 +1,51 @@
+#include "lib/pwm_computer.h"
+
+pwm_computer::pwm_computer(long min_temp, long max_temp,
+                           long min_stop, long min_pwm, long max_pwm) {
+  curve.min_temp = static_cast<double>(min_temp);
+  curve.max_temp = static_cast<double>(max_temp);
+  curve.min_pwm  = static_cast<double>(min_pwm);
+  curve.max_pwm  = static_cast<double>(max_pwm);
+  curve.min_stop = static_cast<double>(min_stop);
+  curve.k1 = 0.0;
+  curve.k2 = 0.0;
+}
+
+void pwm_computer::retune(long min_stop) {
+  curve.min_stop = static_cast<double>(min_stop);
+  fit();
+}
+
+linear_pwm_computer::linear_pwm_computer(long min_temp, long max_temp,
+                                         long min_stop, long min_pwm,
+                                         long max_pwm)
+  : pwm_computer(min_temp, max_temp, min_stop, min_pwm, max_pwm) {
+  fit();
+}
+linear_pwm_computer::linear_pwm_computer(const fancontroller * const fc)
+  : linear_pwm_computer(fc->get_min_temp(), fc->get_max_temp(),
+                        fc->get_min_stop(), fc->get_min_pwm(),
+                        fc->get_max_pwm()) {}
+
+// Line from (min_temp, min_stop) to (max_temp, max_pwm)
+void linear_pwm_computer::fit() {
+  curve.k1 = (curve.max_pwm - curve.min_stop) /
+             (curve.max_temp - curve.min_temp);
+}
+
+quadratic_pwm_computer::quadratic_pwm_computer(long min_temp, long max_temp,
+                                               long min_stop, long min_pwm,
+                                               long max_pwm)
+  : pwm_computer(min_temp, max_temp, min_stop, min_pwm, max_pwm) {
+  fit();
+}
+quadratic_pwm_computer::quadratic_pwm_computer(const fancontroller * const fc)
+  : quadratic_pwm_computer(fc->get_min_temp(), fc->get_max_temp(),
+                           fc->get_min_stop(), fc->get_min_pwm(),
+                           fc->get_max_pwm()) {}
+
+// Parabola with its vertex at (min_temp, min_stop), through (max_temp, max_pwm)
+void quadratic_pwm_computer::fit() {
+  double range = curve.max_temp - curve.min_temp;
+  curve.k2 = (curve.max_pwm - curve.min_stop) / (range * range);
+}
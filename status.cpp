@@ -0,0 +1,59 @@
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "lib/status_page.h"
+
+/*
+ * Prints channel values published by fancontrolcpp in its status page,
+ * without any access to hwmon devices.
+ */
+
+int main(int argc, char ** argv) {
+  if (argc > 2) {
+    std::cerr << "Usage: " << argv[0] << " [status page path]" << std::endl;
+    return 2;
+  }
+  const std::string path = argc > 1 ? argv[1] : STATUS_PAGE_PATH;
+
+  try {
+    status_page_reader reader(path);
+    if (!reader.running()) {
+      std::cerr << "fancontrolcpp is not running" << std::endl;
+      return 1;
+    }
+
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    const int64_t now = static_cast<int64_t>(ts.tv_sec) * 1000000000 +
+                        ts.tv_nsec;
+
+    std::cout << "fancontrolcpp (pid " << reader.get_pid() << ")" << std::endl;
+    for (unsigned int i = 0; i < reader.get_channel_count(); ++i) {
+      status_snapshot s = reader.read(i);
+      std::cout << "FC" << s.id << " "
+                << "Temperature: " << s.temperature
+                << "  Fan speed: " << s.fan_speed
+                << "  PWM value: " << s.pwm;
+      if (s.flags & STATUS_FAULTED)
+        std::cout << "  faulted";
+      if (s.flags & STATUS_STALLED)
+        std::cout << "  stalled";
+      if (s.flags & STATUS_BOOSTED)
+        std::cout << "  boosted";
+      if (s.flags & STATUS_DRIFTED)
+        std::cout << "  drifted";
+      std::cout << "\n  " << s.cycles << " cycles, "
+                << s.overruns << " overruns, "
+                << s.faults << " faults, "
+                << s.stalls << " stalls, "
+                << s.recalibrations << " recalibrations, updated "
+                << (s.updated ? (now - s.updated) / 1000000 : -1)
+                << "ms ago" << std::endl;
+    }
+  } catch (const std::runtime_error & e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,160 @@
+#include "lib/status_page.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static int64_t realtime_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+status_page::status_page(const std::string &path, unsigned int channel_count)
+  : path(path),
+    size(sizeof(status_page_header) +
+         channel_count * sizeof(status_page_channel)) {
+  // Built aside then renamed, readers never see a partial page. A unique
+  // name created exclusively: /dev/shm is world-writable
+  std::vector<char> tmp_name(path.begin(), path.end());
+  const char suffix[] = ".XXXXXX";
+  tmp_name.insert(tmp_name.end(), suffix, suffix + sizeof(suffix));
+  int fd = mkostemp(tmp_name.data(), O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Could not create " + path + ".XXXXXX: " +
+                             std::strerror(errno));
+  const std::string tmp_path(tmp_name.data());
+  if (fchmod(fd, 0644) < 0 || ftruncate(fd, static_cast<off_t>(size)) < 0) {
+    int err = errno;
+    close(fd);
+    unlink(tmp_path.c_str());
+    throw std::runtime_error("Could not set up " + tmp_path + ": " +
+                             std::strerror(err));
+  }
+  map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    unlink(tmp_path.c_str());
+    throw std::runtime_error("Could not map " + tmp_path + "!");
+  }
+
+  // Zero-filled by ftruncate(), which is a valid state for the atomics
+  header = static_cast<status_page_header *>(map);
+  channels = reinterpret_cast<status_page_channel *>(header + 1);
+  header->magic = STATUS_PAGE_MAGIC;
+  header->version = STATUS_PAGE_VERSION;
+  header->header_size = sizeof(status_page_header);
+  header->channel_size = sizeof(status_page_channel);
+  header->channel_count = channel_count;
+  header->pid = getpid();
+  header->started = realtime_ns();
+  header->running.store(1, std::memory_order_release);
+
+  if (rename(tmp_path.c_str(), path.c_str()) < 0) {
+    int err = errno;
+    munmap(map, size);
+    unlink(tmp_path.c_str());
+    throw std::runtime_error("Could not rename " + tmp_path + ": " +
+                             std::strerror(err));
+  }
+}
+
+status_page::~status_page() {
+  header->running = 0;
+  munmap(map, size);
+  unlink(path.c_str());
+}
+
+void status_page::publish(unsigned int index,
+                          const status_snapshot &snapshot) {
+  status_page_channel & ch = channels[index];
+  const std::memory_order relaxed = std::memory_order_relaxed;
+
+  uint64_t sequence = ch.sequence.load(relaxed);
+  ch.sequence.store(sequence + 1, relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  ch.id.store(snapshot.id, relaxed);
+  ch.flags.store(snapshot.flags, relaxed);
+  ch.updated.store(realtime_ns(), relaxed);
+  ch.temperature.store(snapshot.temperature, relaxed);
+  ch.fan_speed.store(snapshot.fan_speed, relaxed);
+  ch.pwm.store(snapshot.pwm, relaxed);
+  ch.cycles.store(snapshot.cycles, relaxed);
+  ch.overruns.store(snapshot.overruns, relaxed);
+  ch.faults.store(snapshot.faults, relaxed);
+  ch.stalls.store(snapshot.stalls, relaxed);
+  ch.recalibrations.store(snapshot.recalibrations, relaxed);
+
+  ch.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+status_page_reader::status_page_reader(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Could not open " + path + ": " +
+                             std::strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) < 0 ||
+      static_cast<std::size_t>(st.st_size) < sizeof(status_page_header)) {
+    close(fd);
+    throw std::runtime_error(path + " is not a status page!");
+  }
+  size = static_cast<std::size_t>(st.st_size);
+  map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    throw std::runtime_error("Could not map " + path + "!");
+
+  header = static_cast<const status_page_header *>(map);
+  channel_size = header->channel_size;
+  channel_count = header->channel_count;
+  if (header->magic != STATUS_PAGE_MAGIC ||
+      header->version < STATUS_PAGE_VERSION ||
+      channel_size < sizeof(status_page_channel) ||
+      header->header_size < sizeof(status_page_header) ||
+      size < header->header_size + channel_count * channel_size) {
+    munmap(const_cast<void *>(map), size);
+    throw std::runtime_error(path + " is not a compatible status page!");
+  }
+}
+
+status_page_reader::~status_page_reader() {
+  munmap(const_cast<void *>(map), size);
+}
+
+status_snapshot status_page_reader::read(unsigned int index) const {
+  const status_page_channel & ch =
+    *reinterpret_cast<const status_page_channel *>(
+        static_cast<const char *>(map) + header->header_size +
+        index * channel_size);
+  const std::memory_order relaxed = std::memory_order_relaxed;
+
+  status_snapshot s;
+  uint64_t before, after;
+  do {
+    before = ch.sequence.load(std::memory_order_acquire);
+    s.id = ch.id.load(relaxed);
+    s.flags = ch.flags.load(relaxed);
+    s.updated = ch.updated.load(relaxed);
+    s.temperature = ch.temperature.load(relaxed);
+    s.fan_speed = ch.fan_speed.load(relaxed);
+    s.pwm = ch.pwm.load(relaxed);
+    s.cycles = ch.cycles.load(relaxed);
+    s.overruns = ch.overruns.load(relaxed);
+    s.faults = ch.faults.load(relaxed);
+    s.stalls = ch.stalls.load(relaxed);
+    s.recalibrations = ch.recalibrations.load(relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = ch.sequence.load(relaxed);
+  } while ((before & 1) || before != after);
+  return s;
+}